@@ -47,6 +47,23 @@ struct DelayWidget : widgets::XTModuleWidget
              {"Softclip @+/-5V (Surge VST Behavior)", M::ClipMode::SOFTCLIP_DELAYLINE_5V},
              {"Softclip @+/-10V", M::ClipMode::SOFTCLIP_DELAYLINE_10V},
              {"Hardclip @+/-10V", M::ClipMode::HARDCLIP_DELAYLINE_10V}});
+
+        menu->addChild(new rack::ui::MenuSeparator);
+        auto xtm = static_cast<M *>(module);
+        bool t = xtm->polyphonicMode;
+        menu->addChild(rack::createMenuItem("Monophonic Stereo Processing", CHECKMARK(!t),
+                                            [xtm] { xtm->setPolyphonicMode(false); }));
+        menu->addChild(rack::createMenuItem("Polyphonic Stereo Processing", CHECKMARK(t),
+                                            [xtm] { xtm->setPolyphonicMode(true); }));
+        menu->addChild(rack::createSubmenuItem("Polyphonic Maximum Time", "", [xtm](auto *x) {
+            float pmt = xtm->polyMaxTime;
+            for (auto mt : M::polyMaxTimeChoices)
+            {
+                auto lab = fmt::format("{:.1f} s", mt);
+                x->addChild(rack::createMenuItem(lab, CHECKMARK(mt == pmt),
+                                                 [xtm, mt] { xtm->setPolyMaxTime(mt); }));
+            }
+        }));
     }
 
     void selectModulator(int mod) override
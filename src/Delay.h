@@ -23,9 +23,15 @@
 #include "XTModule.h"
 #include "rack.hpp"
 #include <cstring>
+#include <atomic>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include "DebugHelpers.h"
 #include "globals.h"
 #include "BiquadFilter.h"
+#include "Semaphore.h"
 
 #include "dsp/utilities/SSESincDelayLine.h"
 #include "TemposyncSupport.h"
@@ -127,7 +133,7 @@ struct Delay : modules::XTModule, sst::rackhelpers::module_connector::NeighborCo
             else
             {
                 auto tl = m->storage->note_to_pitch_ignoring_tuning(12 * v);
-                tl = std::clamp(m->storage->samplerate * tl, 0.f, delayLineLength * 1.f) *
+                tl = std::clamp(m->storage->samplerate * tl, 0.f, m->maxDelaySamples()) *
                      m->storage->samplerate_inv;
                 return fmt::format("{:7.3f} s", tl);
             }
@@ -219,6 +225,233 @@ struct Delay : modules::XTModule, sst::rackhelpers::module_connector::NeighborCo
     std::unique_ptr<SSESincDelayLine<delayLineLength>> lineL, lineR;
     std::unique_ptr<BiquadFilter> lpPost, hpPost;
 
+    /*
+     * In polyphonic mode each channel gets its own pair of lines and post filters. Sixteen
+     * stereo voices at the monophonic line length would be 64mb, so the poly lines are sized
+     * by the configured maximum delay time instead. Since the line length is a template
+     * parameter, the bank is built for the smallest power of two which fits and hides that
+     * choice behind a single virtual call per sample.
+     *
+     * Neither the audio thread nor the engine thread allocates or frees voices. A builder
+     * thread, started the first time poly mode is switched on, does all of it. Changing the
+     * mode, the maximum time or the sample rate only asks it for a new bank, which it hands
+     * over through pendingPolyBank once it holds as many voices as the old one did. The audio
+     * thread adopts it at the next sample and puts the bank it replaces (or drops when
+     * leaving poly mode) in retiredPolyBank for the builder to free.
+     *
+     * Voices are built in channel order, only as far as the input channel count the audio
+     * thread has asked for, and published through voicesReady. A channel whose voice isn't
+     * ready yet passes its dry signal, as an empty line would.
+     */
+    std::atomic<bool> polyphonicMode{false};
+    std::atomic<float> polyMaxTime{2.5f};
+    static constexpr std::array<float, 5> polyMaxTimeChoices{0.5f, 1.f, 2.5f, 5.f, 10.f};
+
+    struct PolyVoiceBankBase
+    {
+        virtual ~PolyVoiceBankBase() = default;
+        virtual void buildVoice(SurgeStorage *s, int c) = 0;
+        virtual void processVoices(Delay *d, int nReady, int nChan) = 0;
+
+        int readyVoices(int nChan)
+        {
+            return std::min(nChan, voicesReady.load(std::memory_order_acquire));
+        }
+
+        std::array<std::unique_ptr<BiquadFilter>, MAX_POLY> lpPost, hpPost;
+        std::atomic<int> voicesReady{0};
+        float maxTime{0}, sampleRate{0}, maxSamples{0};
+    };
+
+    template <size_t N> struct PolyVoiceBank : PolyVoiceBankBase
+    {
+        std::array<std::unique_ptr<SSESincDelayLine<N>>, MAX_POLY> lineL, lineR;
+
+        void buildVoice(SurgeStorage *s, int c) override
+        {
+            lineL[c] = std::make_unique<SSESincDelayLine<N>>(s->sinctable);
+            lineR[c] = std::make_unique<SSESincDelayLine<N>>(s->sinctable);
+            lpPost[c] = std::make_unique<BiquadFilter>(s);
+            lpPost[c]->suspend();
+            hpPost[c] = std::make_unique<BiquadFilter>(s);
+            hpPost[c]->suspend();
+        }
+
+        void processVoices(Delay *d, int nReady, int nChan) override
+        {
+            d->processPolyVoices(*this, nReady, nChan);
+        }
+    };
+    std::unique_ptr<PolyVoiceBankBase> polyBank;
+    std::atomic<PolyVoiceBankBase *> pendingPolyBank{nullptr}, retiredPolyBank{nullptr};
+    int polyVoicesWithCoefficients{0};
+
+    static std::unique_ptr<PolyVoiceBankBase> makePolyVoiceBank(size_t samples)
+    {
+        if (samples <= (1 << 15))
+            return std::make_unique<PolyVoiceBank<1 << 15>>();
+        if (samples <= (1 << 16))
+            return std::make_unique<PolyVoiceBank<1 << 16>>();
+        if (samples <= (1 << 17))
+            return std::make_unique<PolyVoiceBank<1 << 17>>();
+        if (samples <= (1 << 18))
+            return std::make_unique<PolyVoiceBank<1 << 18>>();
+        if (samples <= (1 << 19))
+            return std::make_unique<PolyVoiceBank<1 << 19>>();
+        if (samples <= (1 << 20))
+            return std::make_unique<PolyVoiceBank<1 << 20>>();
+        return std::make_unique<PolyVoiceBank<1 << 21>>();
+    }
+
+    std::thread polyBuilder;
+    std::once_flag polyBuilderStarted;
+    modules::Semaphore polyBuilderWake;
+    std::atomic<bool> polyBuilderStop{false}, polyRebuildRequested{false};
+    std::atomic<int> polyVoicesWanted{1};
+    // The newest bank the builder made. Only touched by the builder thread
+    PolyVoiceBankBase *latestPolyBank{nullptr};
+
+    void runPolyBuilder()
+    {
+        while (true)
+        {
+            polyBuilderWake.wait();
+            if (polyBuilderStop.load(std::memory_order_acquire))
+                return;
+
+            auto *r = retiredPolyBank.exchange(nullptr, std::memory_order_acq_rel);
+            if (r == latestPolyBank)
+                latestPolyBank = nullptr;
+            delete r;
+
+            if (polyRebuildRequested.exchange(false, std::memory_order_acq_rel))
+            {
+                if (!polyphonicMode)
+                {
+                    latestPolyBank = nullptr;
+                    delete pendingPolyBank.exchange(nullptr, std::memory_order_acq_rel);
+                    continue;
+                }
+
+                float mt = polyMaxTime;
+                float sr = storage->samplerate;
+                auto ms = std::ceil(mt * sr);
+                auto bank = makePolyVoiceBank((size_t)ms + 2 * FIRipol_N);
+                bank->maxTime = mt;
+                bank->sampleRate = sr;
+                bank->maxSamples = ms;
+                buildPolyVoices(bank.get());
+
+                // a bank the audio thread never picked up is simply replaced
+                latestPolyBank = bank.get();
+                delete pendingPolyBank.exchange(bank.release(), std::memory_order_acq_rel);
+            }
+            else if (latestPolyBank)
+            {
+                buildPolyVoices(latestPolyBank);
+            }
+        }
+    }
+
+    // Builder thread
+    void buildPolyVoices(PolyVoiceBankBase *bank)
+    {
+        auto want = std::clamp(polyVoicesWanted.load(std::memory_order_acquire), 1, MAX_POLY);
+        for (int c = bank->voicesReady.load(std::memory_order_relaxed); c < want; ++c)
+        {
+            bank->buildVoice(storage.get(), c);
+            bank->voicesReady.store(c + 1, std::memory_order_release);
+        }
+    }
+
+    // Any thread. Asks the builder for a fresh bank for the current mode, time and rate
+    void requestPolyVoiceBank()
+    {
+        polyRebuildRequested.store(true, std::memory_order_release);
+        polyBuilderWake.post();
+    }
+
+    // UI thread (or wherever the patch is read); the only place the builder is started
+    void startPolyBuilder()
+    {
+        std::call_once(polyBuilderStarted,
+                       [this]() { polyBuilder = std::thread([this]() { runPolyBuilder(); }); });
+    }
+
+    void setPolyphonicMode(bool b)
+    {
+        polyphonicMode = b;
+        if (b)
+            startPolyBuilder();
+        requestPolyVoiceBank();
+    }
+
+    void setPolyMaxTime(float mt)
+    {
+        polyMaxTime = mt;
+        requestPolyVoiceBank();
+    }
+
+    /*
+     * Audio thread. Asks for more voices when the channel count grows, and adopts a pending
+     * bank, or retires the bank when leaving poly mode, once the retired slot is free.
+     * Returns true if the bank in use changed.
+     */
+    bool updatePolyVoiceBank(bool poly, int nChan)
+    {
+        if (poly && nChan > polyVoicesWanted.load(std::memory_order_relaxed))
+        {
+            polyVoicesWanted.store(nChan, std::memory_order_release);
+            polyBuilderWake.post();
+        }
+
+        if (retiredPolyBank.load(std::memory_order_acquire))
+            return false;
+
+        if (poly && pendingPolyBank.load(std::memory_order_acquire))
+        {
+            auto *p = pendingPolyBank.exchange(nullptr, std::memory_order_acq_rel);
+            retiredPolyBank.store(polyBank.release(), std::memory_order_release);
+            polyBank.reset(p);
+            polyVoicesWithCoefficients = 0;
+            polyBuilderWake.post();
+            return true;
+        }
+        if (!poly && polyBank)
+        {
+            retiredPolyBank.store(polyBank.release(), std::memory_order_release);
+            polyBuilderWake.post();
+            return true;
+        }
+        return false;
+    }
+
+    ~Delay()
+    {
+        if (polyBuilder.joinable())
+        {
+            polyBuilderStop.store(true, std::memory_order_release);
+            polyBuilderWake.post();
+            polyBuilder.join();
+        }
+        delete pendingPolyBank.exchange(nullptr);
+        delete retiredPolyBank.exchange(nullptr);
+    }
+
+    float maxDelaySamples()
+    {
+        if (polyphonicMode)
+            return polyMaxTime * storage->samplerate;
+        return delayLineLength * 1.f;
+    }
+
+    int polyChannelCount()
+    {
+        if (polyphonicMode)
+            return std::max({1, inputs[INPUT_L].getChannels(), inputs[INPUT_R].getChannels()});
+        return 1;
+    }
+
     static int paramModulatedBy(int modIndex)
     {
         int offset = modIndex - DELAY_MOD_PARAM_0;
@@ -231,12 +464,92 @@ struct Delay : modules::XTModule, sst::rackhelpers::module_connector::NeighborCo
     void activateTempoSync() { tempoSync = true; }
     void deactivateTempoSync() { tempoSync = false; }
 
+    /*
+     * Modulation, the delay time pitch math and the filter coefficients run every
+     * slowUpdate samples. The per sample values are ramped linearly to the end of block
+     * target so time modulation stays smooth.
+     */
     static constexpr int slowUpdate{8};
-    int blockPos{0};
+    int blockPos{slowUpdate};
+    bool snapRamps{true};
     float tsL{0}, tsR{0};
-    float modVal{0}, dMod{0}, modPhase{0};
+    float modVal{0}, modPhase{0};
+    float timeL{0}, dTimeL{0}, timeR{0}, dTimeR{0};
+    float feedback{0}, dFeedback{0}, crossfeed{0}, dCrossfeed{0}, mix{0}, dMix{0};
     ClipMode currentClipMode{HARDCLIP_DELAYLINE_10V};
 
+    void setRamp(float &val, float &dVal, float target)
+    {
+        if (snapRamps)
+        {
+            val = target;
+            dVal = 0;
+        }
+        else
+        {
+            dVal = (target - val) / slowUpdate;
+        }
+    }
+
+    void updateBlockRate(int nReady)
+    {
+        modulationAssistant.setupMatrix(this);
+        modulationAssistant.updateValues(this);
+        const auto &mv = modulationAssistant.values;
+
+        currentClipMode = (ClipMode)std::round(params[CLIP_MODE_PARAM].getValue());
+
+        float maxT = delayLineLength * 1.f;
+        if (polyphonicMode && polyBank)
+        {
+            maxT = polyBank->maxSamples;
+            setPolyCoefficients(nReady);
+        }
+        else
+        {
+            lpPost->coeff_LP2B(lpPost->calc_omega(mv[HICUT] / 12.0), 0.707);
+            hpPost->coeff_HP(lpPost->calc_omega(mv[LOCUT] / 12.0), 0.707);
+        }
+
+        auto modFreq = std::clamp(mv[MODRATE], 0.f, 4.f);
+        modFreq = modFreq * modFreq;
+        // 0 -> 16 hz
+        auto dPhase = slowUpdate * storage->samplerate_inv * modFreq;
+        modPhase += dPhase;
+        if (modPhase > 1)
+            modPhase -= 1;
+        modVal = std::sin(modPhase * 2.0 * M_PI);
+
+        auto wobble = 1.0 + 0.02 * mv[TIME_S] + 0.005 * mv[MODDEPTH] * modVal;
+        float tl{0.f}, tr{0.f};
+        if (tempoSync)
+        {
+            tsL = temposync_support::roundTemposync(params[TIME_L].getValue());
+            tsR = temposync_support::roundTemposync(params[TIME_R].getValue());
+
+            auto tvl = 12 * wobble * (tsL + modulationAssistant.modvalues[TIME_L]);
+            tl = storage->samplerate * storage->temposyncratio_inv *
+                 storage->note_to_pitch_ignoring_tuning(tvl);
+            auto tvr = 12 * wobble * (tsR + modulationAssistant.modvalues[TIME_R]);
+            tr = storage->samplerate * storage->temposyncratio_inv *
+                 storage->note_to_pitch_ignoring_tuning(tvr);
+        }
+        else
+        {
+            tl = storage->samplerate *
+                 storage->note_to_pitch_ignoring_tuning(12 * wobble * mv[TIME_L]);
+            tr = storage->samplerate *
+                 storage->note_to_pitch_ignoring_tuning(12 * wobble * mv[TIME_R]);
+        }
+
+        setRamp(timeL, dTimeL, std::clamp(tl, 0.f, maxT));
+        setRamp(timeR, dTimeR, std::clamp(tr, 0.f, maxT));
+        setRamp(feedback, dFeedback, mv[FEEDBACK]);
+        setRamp(crossfeed, dCrossfeed, mv[CROSSFEED]);
+        setRamp(mix, dMix, mv[MIX]);
+        snapRamps = false;
+    }
+
     void process(const ProcessArgs &args) override
     {
         // auto fpuguard = sst::plugininfra::cpufeatures::FPUStateGuard();
@@ -246,74 +559,122 @@ struct Delay : modules::XTModule, sst::rackhelpers::module_connector::NeighborCo
         else
             clockProc.disconnect(this);
 
-        if (blockPos == slowUpdate)
+        int nChan = polyChannelCount();
+        bool poly = polyphonicMode;
+        if (updatePolyVoiceBank(poly, nChan))
         {
-            modulationAssistant.setupMatrix(this);
+            // Switching lines; start the ramps and the new lines clean
+            snapRamps = true;
+            blockPos = slowUpdate;
+        }
+        int nReady = (poly && polyBank) ? polyBank->readyVoices(nChan) : 0;
+
+        if (blockPos >= slowUpdate)
+        {
+            updateBlockRate(nReady);
             blockPos = 0;
+        }
+        else if (nReady > polyVoicesWithCoefficients)
+        {
+            setPolyCoefficients(nReady);
+        }
+
+        timeL += dTimeL;
+        timeR += dTimeR;
+        feedback += dFeedback;
+        crossfeed += dCrossfeed;
+        mix += dMix;
 
-            currentClipMode = (ClipMode)std::round(params[CLIP_MODE_PARAM].getValue());
+        outputs[OUTPUT_L].setChannels(nChan);
+        outputs[OUTPUT_R].setChannels(nChan);
 
-            lpPost->coeff_LP2B(lpPost->calc_omega(modulationAssistant.values[HICUT] / 12.0), 0.707);
-            hpPost->coeff_HP(lpPost->calc_omega(modulationAssistant.values[LOCUT] / 12.0), 0.707);
+        if (poly && polyBank)
+        {
+            polyBank->processVoices(this, nReady, nChan);
+        }
+        else if (poly)
+        {
+            // the bank for this mode hasn't arrived yet
+            processPolyDry(0, nChan);
+        }
+        else
+        {
+            auto il = inputs[INPUT_L].getVoltageSum() * RACK_TO_SURGE_OSC_MUL;
+            auto ir = inputs[INPUT_R].getVoltageSum() * RACK_TO_SURGE_OSC_MUL;
 
-            auto modFreq = std::clamp(modulationAssistant.values[MODRATE], 0.f, 4.f);
-            modFreq = modFreq * modFreq;
-            // 0 -> 16 hz
-            auto dPhase = slowUpdate * storage->samplerate_inv * modFreq;
-            modPhase += dPhase;
-            if (modPhase > 1)
-                modPhase -= 1;
-            float modTarget = std::sin(modPhase * 2.0 * M_PI);
-            dMod = (modTarget - modVal) / slowUpdate;
+            if (!inputs[INPUT_R].isConnected())
+                ir = il;
 
-            if (tempoSync)
-            {
-                tsL = temposync_support::roundTemposync(params[TIME_L].getValue());
-                /*Parameter p;
-                std::cout << tsL << " " << p.tempoSyncNotationValue(tsL) << std::endl;
-                */
-                tsR = temposync_support::roundTemposync(params[TIME_R].getValue());
-            }
+            float ol, orr;
+            processVoice(*lineL, *lineR, *lpPost, *hpPost, il, ir, ol, orr);
+            outputs[OUTPUT_L].setVoltage(ol);
+            outputs[OUTPUT_R].setVoltage(orr);
         }
-        modulationAssistant.updateValues(this);
-        auto il = inputs[INPUT_L].getVoltageSum() * RACK_TO_SURGE_OSC_MUL;
-        auto ir = inputs[INPUT_R].getVoltageSum() * RACK_TO_SURGE_OSC_MUL;
+        blockPos++;
+    }
 
-        if (!inputs[INPUT_R].isConnected())
-            ir = il;
+    void setPolyCoefficients(int nReady)
+    {
+        const auto &mv = modulationAssistant.values;
+        auto lpO = lpPost->calc_omega(mv[HICUT] / 12.0);
+        auto hpO = lpPost->calc_omega(mv[LOCUT] / 12.0);
+        for (int c = 0; c < nReady; ++c)
+        {
+            polyBank->lpPost[c]->coeff_LP2B(lpO, 0.707);
+            polyBank->hpPost[c]->coeff_HP(hpO, 0.707);
+        }
+        polyVoicesWithCoefficients = nReady;
+    }
 
-        modVal += dMod;
+    template <size_t N> void processPolyVoices(PolyVoiceBank<N> &bank, int nReady, int nChan)
+    {
+        // A monophonic input broadcasts to every voice
+        auto lm = (inputs[INPUT_L].getChannels() == 1 ? 0 : 1);
+        auto rm = (inputs[INPUT_R].getChannels() == 1 ? 0 : 1);
+        auto rConnected = inputs[INPUT_R].isConnected();
 
-        auto wobble = 1.0 + 0.02 * modulationAssistant.values[TIME_S] +
-                      0.005 * modulationAssistant.values[MODDEPTH] * modVal;
-        // FIXME - temposync
-        float tl{0.f}, tr{0.f};
-        if (tempoSync)
+        for (int c = 0; c < nReady; ++c)
         {
-            auto tvl = 12 * wobble * (tsL + modulationAssistant.modvalues[TIME_L]);
-            tl = storage->samplerate * storage->temposyncratio_inv *
-                 storage->note_to_pitch_ignoring_tuning(tvl);
-            auto tvr = 12 * wobble * (tsR + modulationAssistant.modvalues[TIME_R]);
-            tr = storage->samplerate * storage->temposyncratio_inv *
-                 storage->note_to_pitch_ignoring_tuning(tvr);
+            auto il = inputs[INPUT_L].getVoltage(lm * c) * RACK_TO_SURGE_OSC_MUL;
+            auto ir = il;
+            if (rConnected)
+                ir = inputs[INPUT_R].getVoltage(rm * c) * RACK_TO_SURGE_OSC_MUL;
+
+            float ol, orr;
+            processVoice(*bank.lineL[c], *bank.lineR[c], *bank.lpPost[c], *bank.hpPost[c], il,
+                         ir, ol, orr);
+            outputs[OUTPUT_L].setVoltage(ol, c);
+            outputs[OUTPUT_R].setVoltage(orr, c);
         }
-        else
+        processPolyDry(nReady, nChan);
+    }
+
+    // Channels in [from, to) have no voice yet, so they pass what an empty line would
+    void processPolyDry(int from, int to)
+    {
+        auto lm = (inputs[INPUT_L].getChannels() == 1 ? 0 : 1);
+        auto rm = (inputs[INPUT_R].getChannels() == 1 ? 0 : 1);
+        auto rConnected = inputs[INPUT_R].isConnected();
+
+        for (int c = from; c < to; ++c)
         {
-            tl = storage->samplerate * storage->note_to_pitch_ignoring_tuning(
-                                           12 * wobble * modulationAssistant.values[TIME_L]);
-            tr = storage->samplerate * storage->note_to_pitch_ignoring_tuning(
-                                           12 * wobble * modulationAssistant.values[TIME_R]);
+            auto il = inputs[INPUT_L].getVoltage(lm * c);
+            auto ir = il;
+            if (rConnected)
+                ir = inputs[INPUT_R].getVoltage(rm * c);
+            outputs[OUTPUT_L].setVoltage((1 - mix) * il, c);
+            outputs[OUTPUT_R].setVoltage((1 - mix) * ir, c);
         }
-        tl = std::clamp(tl, 0.f, delayLineLength * 1.f);
-        tr = std::clamp(tr, 0.f, delayLineLength * 1.f);
+    }
 
-        auto dl = lineL->read(tl);
-        auto dr = lineR->read(tr);
+    template <typename line_t>
+    inline void processVoice(line_t &lL, line_t &lR, BiquadFilter &lp, BiquadFilter &hp, float il,
+                             float ir, float &ol, float &orr)
+    {
+        auto dl = lL.read(timeL);
+        auto dr = lR.read(timeR);
         auto wl{0.f}, wr{0.f};
 
-        float fb = modulationAssistant.values[FEEDBACK];
-        float cf = modulationAssistant.values[CROSSFEED];
-
         switch (currentClipMode)
         {
         case TRANSPARENT:
@@ -341,32 +702,52 @@ struct Delay : modules::XTModule, sst::rackhelpers::module_connector::NeighborCo
             break;
         }
 
-        wl = il + fb * dl + cf * dr;
-        wr = ir + fb * dr + cf * dl;
+        wl = il + feedback * dl + crossfeed * dr;
+        wr = ir + feedback * dr + crossfeed * dl;
 
-        lpPost->process_sample(wl, wr, wl, wr);
-        hpPost->process_sample(wl, wr, wl, wr);
-        lineL->write(wl);
-        lineR->write(wr);
+        lp.process_sample(wl, wr, wl, wr);
+        hp.process_sample(wl, wr, wl, wr);
+        lL.write(wl);
+        lR.write(wr);
 
-        auto mx = modulationAssistant.values[MIX];
-        outputs[OUTPUT_L].setVoltage((mx * dl + (1 - mx) * il) * SURGE_TO_RACK_OSC_MUL);
-        outputs[OUTPUT_R].setVoltage((mx * dr + (1 - mx) * ir) * SURGE_TO_RACK_OSC_MUL);
-        blockPos++;
+        ol = (mix * dl + (1 - mix) * il) * SURGE_TO_RACK_OSC_MUL;
+        orr = (mix * dr + (1 - mix) * ir) * SURGE_TO_RACK_OSC_MUL;
     }
 
     json_t *makeModuleSpecificJson() override
     {
         auto fx = json_object();
         clockProc.toJson(fx);
+        json_object_set_new(fx, "polyphonicMode", json_boolean(polyphonicMode));
+        json_object_set_new(fx, "polyMaxTime", json_real(polyMaxTime));
         return fx;
     }
 
-    void readModuleSpecificJson(json_t *modJ) override { clockProc.fromJson(modJ); }
+    void readModuleSpecificJson(json_t *modJ) override
+    {
+        clockProc.fromJson(modJ);
+
+        auto pm = json_object_get(modJ, "polyphonicMode");
+        if (pm)
+        {
+            polyphonicMode = json_boolean_value(pm);
+        }
+        auto pt = json_object_get(modJ, "polyMaxTime");
+        if (pt)
+        {
+            polyMaxTime = std::clamp((float)json_number_value(pt), polyMaxTimeChoices.front(),
+                                     polyMaxTimeChoices.back());
+        }
+        if (polyphonicMode)
+            startPolyBuilder();
+        requestPolyVoiceBank();
+    }
 
     void moduleSpecificSampleRateChange() override
     {
         clockProc.setSampleRate(APP->engine->getSampleRate());
+        // only a flag and a post; the builder makes the new bank
+        requestPolyVoiceBank();
     }
 };
 } // namespace sst::surgext_rack::delay
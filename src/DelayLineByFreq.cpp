@@ -28,6 +28,19 @@ struct DelayLineByFreqWidget : widgets::XTModuleWidget
 {
     typedef delay::DelayLineByFreq M;
     DelayLineByFreqWidget(M *module);
+
+    void appendModuleSpecificMenu(rack::ui::Menu *menu) override
+    {
+        if (!module)
+            return;
+
+        auto xtm = static_cast<M *>(module);
+        menu->addChild(new rack::ui::MenuSeparator);
+        bool brp = xtm->blockRatePitch;
+        menu->addChild(rack::createMenuItem("Smooth Pitch at Block Rate", CHECKMARK(brp),
+                                            [xtm, brp] { xtm->blockRatePitch = !brp; }));
+        xtm->idleRelease.addMenu(menu);
+    }
 };
 
 DelayLineByFreqWidget::DelayLineByFreqWidget(DelayLineByFreqWidget::M *module) : XTModuleWidget()
@@ -28,10 +28,13 @@
 
 #include <memory>
 #include <array>
+#include <atomic>
 
 #include <sst/rackhelpers/neighbor_connectable.h>
 
 #include "dsp/utilities/SSESincDelayLine.h"
+#include "DelayLinePool.h"
+#include "StereoSincDelayLine.h"
 
 namespace sst::surgext_rack::delay
 {
@@ -64,17 +67,13 @@ struct DelayLineByFreq : modules::XTModule,
 
     DelayLineByFreq() : XTModule()
     {
-        setupSurgeCommon(NUM_PARAMS, false, false);
+        setupSurgeSharedReadOnly(NUM_PARAMS);
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
         configParam(VOCT, -5, 5, 0, "V/Oct Center");
         auto pq = configParam(CORRECTION, 0, 20, 0, "Sample Correction");
         pq->snapEnabled = true;
 
-        for (int i = 0; i < MAX_POLY; ++i)
-        {
-            lineL[i] = std::make_unique<SSESincDelayLine<delayLineLength>>(storage->sinctable);
-            lineR[i] = std::make_unique<SSESincDelayLine<delayLineLength>>(storage->sinctable);
-        }
+        lines.prepare(storage->sinctable, 1);
 
         configInput(INPUT_L, "In Left");
         configInput(INPUT_R, "In Right");
@@ -88,7 +87,18 @@ struct DelayLineByFreq : modules::XTModule,
     std::string getName() override { return "DelayLineByFreq"; }
 
     static constexpr size_t delayLineLength = 1 << 14;
-    std::array<std::unique_ptr<SSESincDelayLine<delayLineLength>>, MAX_POLY> lineL, lineR;
+    PooledVoiceLines<StereoSincDelayLine<delayLineLength>> lines;
+    IdleVoiceRelease idleRelease;
+    int housekeepingCount{BLOCK_SIZE - 1};
+
+    /*
+     * By default the delay time follows the v/oct input every sample so audio rate FM
+     * works. With blockRatePitch on, the pitch to time conversion happens once a block
+     * per voice and the time ramps linearly to the new value over the block.
+     */
+    std::atomic<bool> blockRatePitch{false};
+    float delayTime alignas(16)[MAX_POLY], dDelayTime alignas(16)[MAX_POLY];
+    int rampedVoices{0};
 
     bool isBipolar(int paramId) override
     {
@@ -97,6 +107,18 @@ struct DelayLineByFreq : modules::XTModule,
         return false;
     }
 
+    float delayTimeFor(int chan)
+    {
+        float pitch0 =
+            (params[VOCT].getValue() + 5) * 12 + inputs[INPUT_VOCT].getVoltage(chan) * 12;
+
+        auto n2pinv =
+            storage->note_to_pitch_inv_ignoring_tuning(pitch0) * (1.f / Tunings::MIDI_0_FREQ);
+        float tm = storage->samplerate * n2pinv - params[CORRECTION].getValue();
+
+        return std::clamp(tm, FIRipol_N * 1.f, delayLineLength * 1.f);
+    }
+
     void process(const ProcessArgs &args) override
     {
         // auto fpuguard = sst::plugininfra::cpufeatures::FPUStateGuard();
@@ -115,30 +137,98 @@ struct DelayLineByFreq : modules::XTModule,
 
         auto rInp = inputs[INPUT_R].isConnected() ? INPUT_R : INPUT_L;
 
-        for (int i = 0; i < cc; ++i)
-        {
-            auto il = inputs[INPUT_L].getVoltage(lm * i);
-            auto ir = inputs[rInp].getVoltage(rm * i);
+        if (cc > lines.allocated)
+            lines.guarantee(cc);
 
-            float pitch0 =
-                (params[VOCT].getValue() + 5) * 12 + inputs[INPUT_VOCT].getVoltage(i) * 12;
+        bool blockRate = blockRatePitch;
+        if (++housekeepingCount >= BLOCK_SIZE)
+        {
+            lines.releaseIdle(cc, idleRelease.limitInBlocks(storage->samplerate));
+            housekeepingCount = 0;
+
+            if (blockRate)
+            {
+                for (int i = 0; i < cc; ++i)
+                {
+                    auto target = delayTimeFor(i);
+                    if (i < rampedVoices)
+                    {
+                        dDelayTime[i] = (target - delayTime[i]) * (1.f / BLOCK_SIZE);
+                    }
+                    else
+                    {
+                        delayTime[i] = target;
+                        dDelayTime[i] = 0;
+                    }
+                }
+                rampedVoices = cc;
+            }
+        }
 
-            auto n2p = storage->note_to_pitch_ignoring_tuning(pitch0) * Tunings::MIDI_0_FREQ;
-            float tm = storage->samplerate / n2p - params[CORRECTION].getValue();
+        if (!blockRate)
+        {
+            rampedVoices = 0;
+        }
+        else if (cc > rampedVoices)
+        {
+            // Voices which arrive mid block start at their current pitch
+            for (int i = rampedVoices; i < cc; ++i)
+            {
+                delayTime[i] = delayTimeFor(i);
+                dDelayTime[i] = 0;
+            }
+            rampedVoices = cc;
+        }
 
-            tm = std::clamp(tm, FIRipol_N * 1.f, delayLineLength * 1.f);
+        for (int i = 0; i < cc; ++i)
+        {
+            if (i >= lines.allocated)
+            {
+                // this voice's line is still being cleared after a release
+                outputs[INPUT_L].setVoltage(0.f, i);
+                outputs[INPUT_R].setVoltage(0.f, i);
+                continue;
+            }
 
-            auto dl = lineL[i]->read(tm);
-            auto dr = lineR[i]->read(tm);
+            auto il = inputs[INPUT_L].getVoltage(lm * i);
+            auto ir = inputs[rInp].getVoltage(rm * i);
 
-            lineL[i]->write(il);
-            lineR[i]->write(ir);
+            float tm;
+            if (blockRate)
+            {
+                delayTime[i] += dDelayTime[i];
+                tm = delayTime[i];
+            }
+            else
+            {
+                tm = delayTimeFor(i);
+            }
+
+            float dl, dr;
+            lines[i]->read(tm, dl, dr);
+            lines[i]->write(il, ir);
 
             outputs[INPUT_L].setVoltage(dl, i);
             outputs[INPUT_R].setVoltage(dr, i);
         }
     }
 
+    json_t *makeModuleSpecificJson() override
+    {
+        auto dl = json_object();
+        idleRelease.toJson(dl);
+        json_object_set_new(dl, "blockRatePitch", json_boolean(blockRatePitch));
+        return dl;
+    }
+
+    void readModuleSpecificJson(json_t *modJ) override
+    {
+        idleRelease.fromJson(modJ);
+        auto brp = json_object_get(modJ, "blockRatePitch");
+        if (brp)
+            blockRatePitch = json_boolean_value(brp);
+    }
+
     std::optional<std::vector<labeledStereoPort_t>> getPrimaryInputs() override
     {
         return {{std::make_pair("Input", std::make_pair(INPUT_L, INPUT_R))}};
@@ -44,6 +44,13 @@ struct DelayLineByFreqExpandedWidget : widgets::XTModuleWidget
                          {{"Hardclip @+/- 20V", M::ClampBehavior::HARD_20},
                           {"Hardclip @+/- 10V", M::ClampBehavior::HARD_10},
                           {"Hardclip @+/-  5V", M::ClampBehavior::HARD_5}});
+
+        auto xtm = static_cast<M *>(module);
+        menu->addChild(new rack::ui::MenuSeparator);
+        xtm->idleRelease.addMenu(menu);
+        menu->addChild(rack::createMenuItem(
+            "Audio Rate Modulation Inputs", CHECKMARK(xtm->audioRateModulation),
+            [xtm]() { xtm->audioRateModulation = !xtm->audioRateModulation; }));
     }
 };
 
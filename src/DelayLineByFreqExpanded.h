@@ -28,8 +28,10 @@
 
 #include <memory>
 #include <array>
+#include <random>
 
 #include "dsp/utilities/SSESincDelayLine.h"
+#include "DelayLinePool.h"
 #include "BiquadFilter.h"
 
 #include <sst/rackhelpers/neighbor_connectable.h>
@@ -153,18 +155,12 @@ struct DelayLineByFreqExpanded : modules::XTModule,
     };
     DelayLineByFreqExpanded() : XTModule()
     {
-        setupSurgeCommon(NUM_PARAMS, false, false);
+        setupSurgeSharedReadOnly(NUM_PARAMS);
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
         configParam(VOCT, -5, 5, 0, "V/Oct Center");
         auto pq = configParam(CORRECTION, 0, 20, 1, "Sample Correction");
         pq->snapEnabled = true;
 
-        for (int i = 0; i < MAX_POLY; ++i)
-        {
-            lineL[i] = std::make_unique<SSESincDelayLine<delayLineLength>>(storage->sinctable);
-            lineR[i] = std::make_unique<SSESincDelayLine<delayLineLength>>(storage->sinctable);
-        }
-
         configParam(VOCT_FINE_LEFT, -100, 100, 0, "Fine Left Tune", " Cents");
         configParam(VOCT_FINE_RIGHT, -100, 100, 0, "Fine Left Tune", " Cents");
 
@@ -210,20 +206,27 @@ struct DelayLineByFreqExpanded : modules::XTModule,
         configBypass(INPUT_L, OUTPUT_L);
         configBypass(INPUT_R, OUTPUT_R);
 
+        // The storage is shared across modules so don't draw our seed from its generator
         gen = std::default_random_engine();
-        gen.seed(storage->rand_u32());
+        gen.seed(std::random_device{}());
         distro = std::uniform_real_distribution<float>(-1.f, 1.f);
 
+        for (int i = 0; i < MAX_POLY; ++i)
+        {
+            vuLevel[i] = 0.f;
+        }
+        lineL.prepare(storage->sinctable, 1);
+        lineR.prepare(storage->sinctable, 1);
         for (int i = 0; i < MAX_POLY; ++i)
         {
             lpFB[i] = std::make_unique<BiquadFilter>(storage.get());
             lpFB[i]->suspend();
             hpFB[i] = std::make_unique<BiquadFilter>(storage.get());
             hpFB[i]->suspend();
-
-            vuLevel[i] = 0.f;
         }
 
+        // Mod inputs are sampled once a block and ramped; audio rate runs them every sample
+        offersAudioRateModulation = true;
         modAssist.initialize(this);
     }
     std::string getName() override { return "DelayLineByFreqExpanded"; }
@@ -231,7 +234,8 @@ struct DelayLineByFreqExpanded : modules::XTModule,
     std::default_random_engine gen;
     std::uniform_real_distribution<float> distro;
     static constexpr size_t delayLineLength = 1 << 14;
-    std::array<std::unique_ptr<SSESincDelayLine<delayLineLength>>, MAX_POLY> lineL, lineR;
+    PooledVoiceLines<SSESincDelayLine<delayLineLength>> lineL, lineR;
+    IdleVoiceRelease idleRelease;
 
     modules::ModulationAssistant<DelayLineByFreqExpanded, n_mod_params, VOCT, n_mod_inputs,
                                  MOD_INPUT_0>
@@ -239,6 +243,14 @@ struct DelayLineByFreqExpanded : modules::XTModule,
 
     std::array<std::unique_ptr<BiquadFilter>, MAX_POLY> lpFB, hpFB;
 
+    // Every voice has its filters and lines from construction; the lines are only taken
+    // and handed back for clearing as the channel count moves
+    void guaranteeVoices(int nc)
+    {
+        lineL.guarantee(nc);
+        lineR.guarantee(nc);
+    }
+
     bool isBipolar(int paramId) override
     {
         if (paramId == VOCT || paramId == VOCT_FINE_LEFT || paramId == VOCT_FINE_RIGHT)
@@ -288,10 +300,19 @@ struct DelayLineByFreqExpanded : modules::XTModule,
         if (processCount == BLOCK_SIZE)
         {
             int cc = std::max({lc, rc, inputs[INPUT_VOCT].getChannels(), 1});
+            if (cc > lineL.allocated || cc > lineR.allocated)
+                guaranteeVoices(cc);
+            auto idleLimit = idleRelease.limitInBlocks(storage->samplerate);
+            lineL.releaseIdle(cc, idleLimit);
+            lineR.releaseIdle(cc, idleLimit);
             nChan = cc;
 
             modAssist.setupMatrix(this);
-            modAssist.updateValues(this);
+            bool ar = audioRateModulation;
+            for (int i = 0; i < n_mod_inputs; ++i)
+                modAssist.audioRate[i] = ar;
+            modAssist.updateRampTargets(this, BLOCK_SIZE);
+            modAssist.stepRamp(this);
 
             auto cv = (ClampBehavior)params[CLAMP_BEHAVIOR].getValue();
             switch (cv)
@@ -315,7 +336,8 @@ struct DelayLineByFreqExpanded : modules::XTModule,
             {
                 for (int p = 0; p < MAX_POLY; ++p)
                 {
-                    lpFB[p]->suspend();
+                    if (lpFB[p])
+                        lpFB[p]->suspend();
                 }
                 useLP = tLP;
                 lpToggle = true;
@@ -325,7 +347,8 @@ struct DelayLineByFreqExpanded : modules::XTModule,
             {
                 for (int p = 0; p < MAX_POLY; ++p)
                 {
-                    hpFB[p]->suspend();
+                    if (hpFB[p])
+                        hpFB[p]->suspend();
                 }
                 useHP = tHP;
                 hpToggle = true;
@@ -357,7 +380,7 @@ struct DelayLineByFreqExpanded : modules::XTModule,
         else
         {
             // Do this every one so we can do like voct fm and stuff
-            modAssist.updateValues(this);
+            modAssist.stepRamp(this);
         }
 
         // If LC or RC are 1 we want to braodcast that input to all poly channels
@@ -379,8 +402,17 @@ struct DelayLineByFreqExpanded : modules::XTModule,
         if (rFbInput == INPUT_FBL)
             rfm = lfm;
 
+        int readyChan = std::min(lineL.allocated, lineR.allocated);
         for (int i = 0; i < nChan; ++i)
         {
+            if (i >= readyChan)
+            {
+                // this voice's lines are still being cleared after a release
+                outputs[INPUT_L].setVoltage(0.f, i);
+                outputs[INPUT_R].setVoltage(0.f, i);
+                continue;
+            }
+
             float pitch0 =
                 (modAssist.values[VOCT][i] + 5) * 12 + inputs[INPUT_VOCT].getVoltage(i) * 12;
 
@@ -469,6 +501,18 @@ struct DelayLineByFreqExpanded : modules::XTModule,
         vuFalloff = exp(-2.0 * M_PI * 8 / APP->engine->getSampleRate());
     }
 
+    json_t *makeModuleSpecificJson() override
+    {
+        auto dl = json_object();
+        idleRelease.toJson(dl);
+        return dl;
+    }
+
+    void readModuleSpecificJson(json_t *modJ) override
+    {
+        idleRelease.fromJson(modJ);
+    }
+
     std::optional<std::vector<labeledStereoPort_t>> getPrimaryInputs() override
     {
         return {{std::make_pair("Input", std::make_pair(INPUT_L, INPUT_R))}};
@@ -0,0 +1,293 @@
+/*
+ * SurgeXT for VCV Rack - a Surge Synth Team product
+ *
+ * A set of modules expressing Surge XT into the VCV Rack Module Ecosystem
+ *
+ * Copyright 2019 - 2024, Various authors, as described in the github
+ * transaction log.
+ *
+ * Surge XT for VCV Rack is released under the GNU General Public License
+ * 3.0 or later (GPL-3.0-or-later). A copy of the license is in this
+ * repository in the file "LICENSE" or at:
+ *
+ * or at https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * All source for Surge XT for VCV Rack is available at
+ * https://github.com/surge-synthesizer/surge-rack/
+ */
+
+#ifndef SURGE_XT_RACK_SRC_DELAYLINEPOOL_H
+#define SURGE_XT_RACK_SRC_DELAYLINEPOOL_H
+
+#include "SurgeXT.h"
+#include "rack.hpp"
+#include "globals.h"
+#include "Semaphore.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "dsp/utilities/SSESincDelayLine.h"
+
+namespace sst::surgext_rack::delay
+{
+/*
+ * A process wide thread which does the slow half of handing a tuned delay voice back:
+ * clearing its lines, so the audio thread never memsets a whole line when a voice comes
+ * back to life. Every PooledVoiceLines attaches when it is prepared and detaches when it
+ * goes away; the thread is started by the first attach and joined by the last detach, so
+ * it never outlives the modules which use it and nothing is joined at static destruction.
+ */
+struct DelayLineHousekeeper
+{
+    struct Client
+    {
+        virtual ~Client() = default;
+        // Housekeeper thread
+        virtual void housekeep() = 0;
+    };
+
+    // Not the audio thread
+    static void attach(Client *c)
+    {
+        std::lock_guard<std::mutex> g(registryMutex());
+        clients().push_back(c);
+        if (!instance())
+        {
+            instance() = std::unique_ptr<DelayLineHousekeeper>(new DelayLineHousekeeper());
+            instancePtr().store(instance().get(), std::memory_order_release);
+        }
+    }
+
+    // Not the audio thread
+    static void detach(Client *c)
+    {
+        std::unique_ptr<DelayLineHousekeeper> stopping;
+        {
+            std::lock_guard<std::mutex> g(registryMutex());
+            auto &cl = clients();
+            cl.erase(std::remove(cl.begin(), cl.end(), c), cl.end());
+            if (cl.empty())
+            {
+                instancePtr().store(nullptr, std::memory_order_release);
+                stopping = std::move(instance());
+            }
+        }
+        // joined outside the registry lock, which the thread takes to do its work
+        stopping.reset();
+    }
+
+    // Audio thread. Only called by an attached client, so the housekeeper exists
+    static void wake()
+    {
+        if (auto *h = instancePtr().load(std::memory_order_acquire))
+            h->wakeSem.post();
+    }
+
+    ~DelayLineHousekeeper()
+    {
+        stop.store(true, std::memory_order_release);
+        wakeSem.post();
+        thread.join();
+    }
+
+  private:
+    DelayLineHousekeeper()
+    {
+        thread = std::thread([this]() {
+            while (true)
+            {
+                wakeSem.wait();
+                if (stop.load(std::memory_order_acquire))
+                    return;
+                std::lock_guard<std::mutex> g(registryMutex());
+                for (auto *c : clients())
+                    c->housekeep();
+            }
+        });
+    }
+
+    static std::mutex &registryMutex()
+    {
+        static std::mutex m;
+        return m;
+    }
+    static std::vector<Client *> &clients()
+    {
+        static std::vector<Client *> c;
+        return c;
+    }
+    static std::unique_ptr<DelayLineHousekeeper> &instance()
+    {
+        static std::unique_ptr<DelayLineHousekeeper> h;
+        return h;
+    }
+    static std::atomic<DelayLineHousekeeper *> &instancePtr()
+    {
+        static std::atomic<DelayLineHousekeeper *> p{nullptr};
+        return p;
+    }
+
+    modules::Semaphore wakeSem;
+    std::atomic<bool> stop{false};
+    std::thread thread;
+};
+
+/*
+ * One line per voice for a module. prepare builds a line for every voice the module could
+ * ever run, off the audio thread, so a voice never waits on an allocation when the channel
+ * count grows. Voices [0, allocated) are in use; voices above the current channel count
+ * are released from the top once they have been idle for the configured number of blocks.
+ * A released line is cleared by the housekeeper before it can be taken again, so a voice
+ * which comes back within that moment starts a block or so late rather than replaying what
+ * it held. guarantee and releaseIdle are audio thread safe and never allocate or lock.
+ */
+template <typename L> struct PooledVoiceLines : DelayLineHousekeeper::Client
+{
+    typedef L line_t;
+
+    enum LineState
+    {
+        lineClean,
+        lineInUse,
+        lineDirty
+    };
+
+    std::array<std::unique_ptr<line_t>, MAX_POLY> lines;
+    std::array<std::atomic<int>, MAX_POLY> state{};
+    std::array<uint32_t, MAX_POLY> idleBlocks{};
+    int allocated{0};
+    bool attached{false};
+
+    PooledVoiceLines() = default;
+    PooledVoiceLines(const PooledVoiceLines &) = delete;
+    PooledVoiceLines &operator=(const PooledVoiceLines &) = delete;
+
+    ~PooledVoiceLines()
+    {
+        if (attached)
+            DelayLineHousekeeper::detach(this);
+    }
+
+    line_t *operator[](int c) { return lines[c].get(); }
+
+    // Not the audio thread. Builds every voice's line against st and takes the first nChan.
+    void prepare(const float *st, int nChan)
+    {
+        for (int c = 0; c < MAX_POLY; ++c)
+        {
+            if (!lines[c])
+                lines[c] = std::make_unique<line_t>(st);
+            state[c].store(lineClean, std::memory_order_release);
+        }
+        if (!attached)
+        {
+            DelayLineHousekeeper::attach(this);
+            attached = true;
+        }
+        guarantee(nChan);
+    }
+
+    void guarantee(int nChan)
+    {
+        for (int c = allocated; c < nChan; ++c)
+        {
+            // a line released moments ago may still be being cleared
+            if (state[c].load(std::memory_order_acquire) != lineClean)
+                break;
+            state[c].store(lineInUse, std::memory_order_relaxed);
+            idleBlocks[c] = 0;
+            allocated = c + 1;
+        }
+    }
+
+    // Call once a block with the active channel count. idleLimit of 0 never releases.
+    void releaseIdle(int nChan, uint32_t idleLimit)
+    {
+        for (int c = 0; c < std::min(nChan, allocated); ++c)
+            idleBlocks[c] = 0;
+        for (int c = nChan; c < allocated; ++c)
+            idleBlocks[c]++;
+
+        if (idleLimit == 0)
+            return;
+
+        auto keep = allocated;
+        while (keep > nChan && keep > 1 && idleBlocks[keep - 1] >= idleLimit)
+            keep--;
+        releaseAbove(keep);
+    }
+
+    // Hands lines from the top down to the housekeeper for clearing
+    void releaseAbove(int keep)
+    {
+        if (allocated <= keep)
+            return;
+        while (allocated > keep)
+        {
+            state[allocated - 1].store(lineDirty, std::memory_order_release);
+            allocated--;
+        }
+        DelayLineHousekeeper::wake();
+    }
+
+    void housekeep() override
+    {
+        for (int c = 0; c < MAX_POLY; ++c)
+        {
+            if (state[c].load(std::memory_order_acquire) != lineDirty)
+                continue;
+            lines[c]->clear();
+            state[c].store(lineClean, std::memory_order_release);
+        }
+    }
+};
+
+/*
+ * How long an unused voice keeps its lines, in seconds. Zero means never release.
+ */
+struct IdleVoiceRelease
+{
+    static constexpr std::array<float, 5> choices{0.f, 1.f, 5.f, 30.f, 120.f};
+    std::atomic<float> seconds{5.f};
+
+    uint32_t limitInBlocks(float samplerate) const
+    {
+        float s = seconds;
+        if (s <= 0)
+            return 0;
+        return std::max((uint32_t)1, (uint32_t)(s * samplerate / BLOCK_SIZE));
+    }
+
+    void toJson(json_t *j) const
+    {
+        json_object_set_new(j, "idleVoiceReleaseSeconds", json_real(seconds));
+    }
+
+    void fromJson(json_t *j)
+    {
+        auto s = json_object_get(j, "idleVoiceReleaseSeconds");
+        if (s)
+            seconds = std::clamp((float)json_number_value(s), choices.front(), choices.back());
+    }
+
+    void addMenu(rack::ui::Menu *menu)
+    {
+        menu->addChild(rack::createSubmenuItem("Release Unused Voices", "", [this](auto *x) {
+            float cs = seconds;
+            for (auto c : choices)
+            {
+                auto lab = (c <= 0) ? std::string("Never") : fmt::format("After {} s", (int)c);
+                x->addChild(
+                    rack::createMenuItem(lab, CHECKMARK(c == cs), [this, c] { seconds = c; }));
+            }
+        }));
+    }
+};
+} // namespace sst::surgext_rack::delay
+#endif
@@ -77,9 +77,7 @@ struct DigitalRingMod : modules::XTModule,
 
     DigitalRingMod() : XTModule()
     {
-        std::lock_guard<std::mutex> ltg(xtSurgeCreateMutex);
-
-        setupSurgeCommon(NUM_PARAMS, false, false);
+        setupSurgeSharedReadOnly(NUM_PARAMS);
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
         auto linkS =
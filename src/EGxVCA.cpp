@@ -66,6 +66,9 @@ struct EGxVCAWidget : public widgets::XTModuleWidget
     widgets::DirtyHelper<EGxVCA, false> modeDirty, analogDigitalDirty;
     void step() override
     {
+        if (module)
+            static_cast<M *>(module)->updateEnvelopeSet();
+
         if ((modeDirty.dirty() || analogDigitalDirty.dirty()) && aShape && dShape && rShape)
         {
             auto type = modeDirty.lastValue;
@@ -23,13 +23,16 @@
 #include "dsp/Effect.h"
 #include "XTModule.h"
 #include "rack.hpp"
+#include <atomic>
 #include <cstring>
+#include <memory>
 
 #include "DebugHelpers.h"
 #include "FxPresetAndClipboardManager.h"
 
 #include "LayoutEngine.h"
 #include "ADSRModulationSource.h"
+#include "EnvelopeBank.h"
 
 #include "sst/basic-blocks/modulators/ADSREnvelope.h"
 #include "sst/basic-blocks/modulators/DAHDEnvelope.h"
@@ -247,10 +250,7 @@ struct EGxVCA : modules::XTModule, sst::rackhelpers::module_connector::NeighborC
 
     EGxVCA() : XTModule()
     {
-        {
-            std::lock_guard<std::mutex> lgxt(xtSurgeCreateMutex);
-            setupSurge();
-        }
+        setupSurge();
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
         configParam<modules::DecibelParamQuantity>(LEVEL, 0, 2, 1, "Level");
@@ -329,29 +329,84 @@ struct EGxVCA : modules::XTModule, sst::rackhelpers::module_connector::NeighborC
 
     float meterLevels[MAX_POLY];
 
-    std::array<std::unique_ptr<envelopeAdsr_t>, MAX_POLY> processorsAdsr;
-    std::array<std::unique_ptr<envelopeAdsrSlow_t>, MAX_POLY> processorsAdsrSlow;
-    std::array<std::unique_ptr<envelopeDahd_t>, MAX_POLY> processorsDahd;
-    std::array<std::unique_ptr<envelopeDahdSlow_t>, MAX_POLY> processorsDahdSlow;
+    /*
+     * The mode and speed switches pick one of four envelope flavours. Only the flavour in
+     * use has a bank. A new set is built off the audio thread (updateEnvelopeSet, from the
+     * widget step or a patch load) and handed over through pendingEnvelopes; the audio
+     * thread keeps the old set running until it arrives, swaps, and hands the old one back
+     * through retiredEnvelopes for the UI to free.
+     */
+    static int envelopeFlavourFor(bool mode, bool slow) { return (mode ? 2 : 0) + (slow ? 1 : 0); }
+    int envelopeFlavour() { return envelopeFlavourFor(getMode(), isSlow()); }
+
+    struct EnvelopeSet
+    {
+        EnvelopeSet(SurgeStorage *s, int f) : flavour(f)
+        {
+            switch (f)
+            {
+            case 0:
+                adsr = std::make_unique<modules::EnvelopeBank<envelopeAdsr_t>>(s);
+                break;
+            case 1:
+                adsrSlow = std::make_unique<modules::EnvelopeBank<envelopeAdsrSlow_t>>(s);
+                break;
+            case 2:
+                dahd = std::make_unique<modules::EnvelopeBank<envelopeDahd_t>>(s);
+                break;
+            default:
+                dahdSlow = std::make_unique<modules::EnvelopeBank<envelopeDahdSlow_t>>(s);
+                break;
+            }
+        }
+
+        // Call f with the one bank this set holds
+        template <typename F> void visit(F &&f)
+        {
+            if (adsr)
+                f(*adsr);
+            else if (adsrSlow)
+                f(*adsrSlow);
+            else if (dahd)
+                f(*dahd);
+            else
+                f(*dahdSlow);
+        }
+
+        const int flavour;
+        std::unique_ptr<modules::EnvelopeBank<envelopeAdsr_t>> adsr;
+        std::unique_ptr<modules::EnvelopeBank<envelopeAdsrSlow_t>> adsrSlow;
+        std::unique_ptr<modules::EnvelopeBank<envelopeDahd_t>> dahd;
+        std::unique_ptr<modules::EnvelopeBank<envelopeDahdSlow_t>> dahdSlow;
+    };
+    std::unique_ptr<EnvelopeSet> envelopes; // audio thread owned
+    std::atomic<EnvelopeSet *> pendingEnvelopes{nullptr}, retiredEnvelopes{nullptr};
+    std::atomic<int> activeFlavour{0};
+
     std::array<rack::dsp::SchmittTrigger, MAX_POLY> triggers;
+
+    ~EGxVCA()
+    {
+        delete pendingEnvelopes.exchange(nullptr);
+        delete retiredEnvelopes.exchange(nullptr);
+    }
+
     void setupSurge()
     {
         setupSurgeCommon(NUM_PARAMS, false, false);
 
+        envelopes = std::make_unique<EnvelopeSet>(storage.get(), 0);
+
         for (int i = 0; i < MAX_POLY; ++i)
         {
-            processorsAdsr[i] = std::make_unique<envelopeAdsr_t>(storage.get());
-            processorsAdsrSlow[i] = std::make_unique<envelopeAdsrSlow_t>(storage.get());
-            processorsDahd[i] = std::make_unique<envelopeDahd_t>(storage.get());
-            processorsDahdSlow[i] = std::make_unique<envelopeDahdSlow_t>(storage.get());
             doAttack[i] = false;
 
-            level[i].target = 1.0;
-            response[i].target = 0.0;
-            pan[i][0].target = 1.0; // L
-            pan[i][1].target = 1.0; // R
-            pan[i][2].target = 0.0; // R in L
-            pan[i][3].target = 0.0; // L in R
+            level.target[i] = 1.0;
+            response.target[i] = 0.0;
+            pan[0].target[i] = 1.0; // L
+            pan[1].target[i] = 1.0; // R
+            pan[2].target[i] = 0.0; // R in L
+            pan[3].target[i] = 0.0; // L in R
 
             eocCountdown[i] = 0;
         }
@@ -393,17 +448,10 @@ struct EGxVCA : modules::XTModule, sst::rackhelpers::module_connector::NeighborC
     void moduleSpecificSampleRateChange() override
     {
         clockProc.setSampleRate(APP->engine->getSampleRate());
-        for (int i = 0; i < MAX_POLY; ++i)
-        {
-            if (processorsAdsr[i])
-                processorsAdsr[i]->onSampleRateChanged();
-            if (processorsDahd[i])
-                processorsDahd[i]->onSampleRateChanged();
-            if (processorsAdsrSlow[i])
-                processorsAdsrSlow[i]->onSampleRateChanged();
-            if (processorsDahdSlow[i])
-                processorsDahdSlow[i]->onSampleRateChanged();
-        }
+        envelopes->visit([](auto &bank) {
+            for (int i = 0; i < MAX_POLY; ++i)
+                bank[i]->onSampleRateChanged();
+        });
 
         // triggers for 10 ms
         eocInit = 0.01 * APP->engine->getSampleRate() * BLOCK_SIZE_INV;
@@ -420,25 +468,36 @@ struct EGxVCA : modules::XTModule, sst::rackhelpers::module_connector::NeighborC
 
     bool doAttack[MAX_POLY];
 
-    int eocCountdown[MAX_POLY];
+    int32_t eocCountdown alignas(16)[MAX_POLY];
+    int32_t eocFire alignas(16)[MAX_POLY]{}, eocHeld alignas(16)[MAX_POLY]{};
     int eocInit;
 
-    struct linterp
+    /*
+     * Level, response and the pan matrix ramp linearly over each block. Each is held
+     * voice contiguous so the VCA stage and the ramps step four voices per SSE op.
+     */
+    struct linterpBank
     {
-        float target{0};
-        float dtarget{0};
-        inline void setTarget(float f) { dtarget = (f - target) * BLOCK_SIZE_INV; }
-        inline void step() { target += dtarget; }
+        float target alignas(16)[MAX_POLY]{};
+        float dtarget alignas(16)[MAX_POLY]{};
+        inline void setTarget(int c, float f) { dtarget[c] = (f - target[c]) * BLOCK_SIZE_INV; }
+        inline void hold(int c) { dtarget[c] = 0; }
+        inline __m128 get(int c) const { return _mm_load_ps(&target[c]); }
+        inline void step(int c)
+        {
+            _mm_store_ps(&target[c], _mm_add_ps(get(c), _mm_load_ps(&dtarget[c])));
+        }
     };
 
-    linterp level[MAX_POLY], response[MAX_POLY];
-    linterp pan[MAX_POLY][4];
+    linterpBank level, response;
+    linterpBank pan[4];
+    float envOut alignas(16)[MAX_POLY]{}, envOutCubed alignas(16)[MAX_POLY]{};
 
     float aTS{0}, dTS{0}, sTS{0}, rTS{0};
 
     template <typename ENVT>
     void processFastSlow(const typename rack::Module::ProcessArgs &args,
-                         const std::array<std::unique_ptr<ENVT>, MAX_POLY> &procs)
+                         const modules::EnvelopeBank<ENVT> &procs)
     {
         if (inputs[CLOCK_IN].isConnected())
             clockProc.process(this, CLOCK_IN);
@@ -503,8 +562,8 @@ struct EGxVCA : modules::XTModule, sst::rackhelpers::module_connector::NeighborC
             for (int c = 0; c < nChan; ++c)
             {
                 auto nl = modules::DecibelParamQuantity::ampToLinear(modAssist.values[LEVEL][c]);
-                level[c].setTarget(nl);
-                response[c].setTarget(modAssist.values[RESPONSE][c]);
+                level.setTarget(c, nl);
+                response.setTarget(c, modAssist.values[RESPONSE][c]);
 
                 if (inputs[INPUT_R].isConnected())
                 {
@@ -523,7 +582,7 @@ struct EGxVCA : modules::XTModule, sst::rackhelpers::module_connector::NeighborC
                     }
                     for (int pl = 0; pl < 4; pl++)
                     {
-                        pan[c][pl].setTarget(pm[pl]);
+                        pan[pl].setTarget(c, pm[pl]);
                     }
                 }
                 else
@@ -534,10 +593,19 @@ struct EGxVCA : modules::XTModule, sst::rackhelpers::module_connector::NeighborC
                         modAssist.values[PAN][c] * 0.5 + 0.5, pm);
                     for (int pl = 0; pl < 4; pl++)
                     {
-                        pan[c][pl].setTarget(pm[pl]);
+                        pan[pl].setTarget(c, pm[pl]);
                     }
                 }
             }
+
+            // Unused voices share SSE lanes with used ones, so keep them from drifting
+            for (int c = nChan; c < MAX_POLY; ++c)
+            {
+                level.hold(c);
+                response.hold(c);
+                for (int pl = 0; pl < 4; pl++)
+                    pan[pl].hold(c);
+            }
         }
 
         for (int c = 0; c < nChan; ++c)
@@ -551,16 +619,37 @@ struct EGxVCA : modules::XTModule, sst::rackhelpers::module_connector::NeighborC
         int as = (int)std::round(params[A_SHAPE].getValue());
         int ds = (int)std::round(params[D_SHAPE].getValue());
         int rs = (int)std::round(params[R_SHAPE].getValue());
+        auto dig = params[ANALOG_OR_DIGITAL].getValue() < 0.5;
+        auto az = (int)std::round(params[ATTACK_FROM].getValue());
+        auto mode = getMode();
 
         auto ett = (EOC_TYPES)std::round(params[EOC_TYPE].getValue());
 
+        // Gate highs four voices per compare; a mono gate drives every voice
+        int gateMask{0};
+        if (polyGate)
+        {
+            const auto two = _mm_set1_ps(2.f);
+            for (int c = 0; c < nChan; c += 4)
+            {
+                auto g = _mm_cmpgt_ps(_mm_loadu_ps(inputs[GATE_IN].getVoltages(c)), two);
+                gateMask |= _mm_movemask_ps(g) << c;
+            }
+        }
+        else if (inputs[GATE_IN].getVoltage() > 2)
+        {
+            gateMask = (1 << MAX_POLY) - 1;
+        }
+
+        /*
+         * The envelope stage machine is the upstream scalar object, so it steps per voice.
+         * It only records whether each voice fired or held its stage; the countdowns and the
+         * EOC output run four voices at a time below.
+         */
         for (int c = 0; c < nChan; ++c)
         {
             if (doAttack[c])
             {
-                auto as = (int)std::round(params[A_SHAPE].getValue());
-                auto dig = params[ANALOG_OR_DIGITAL].getValue() < 0.5;
-                auto az = (int)std::round(params[ATTACK_FROM].getValue());
                 auto av = modAssist.values[EG_A][c];
                 if (tempoSynced)
                 {
@@ -574,6 +663,7 @@ struct EGxVCA : modules::XTModule, sst::rackhelpers::module_connector::NeighborC
                     eocCountdown[c] = eocInit;
                 }
             }
+            bool gate = (gateMask >> c) & 1;
             auto pst = procs[c]->stage;
             if (tempoSynced)
             {
@@ -581,34 +671,47 @@ struct EGxVCA : modules::XTModule, sst::rackhelpers::module_connector::NeighborC
                 auto dv = dTS + modAssist.modvalues[EG_D][c];
                 auto sv = sTS + modAssist.modvalues[EG_S][c];
                 auto rv = rTS + modAssist.modvalues[EG_R][c];
-                procs[c]->process(av, dv, getMode() == 0 ? modAssist.values[EG_S][c] : sv, rv, as,
-                                  ds, rs, inputs[GATE_IN].getVoltage(polyGate * c) > 2);
+                procs[c]->process(av, dv, !mode ? modAssist.values[EG_S][c] : sv, rv, as, ds, rs,
+                                  gate);
             }
             else
             {
                 procs[c]->process(modAssist.values[EG_A][c], modAssist.values[EG_D][c],
                                   modAssist.values[EG_S][c], modAssist.values[EG_R][c], as, ds, rs,
-                                  inputs[GATE_IN].getVoltage(polyGate * c) > 2);
+                                  gate);
             }
             auto nst = procs[c]->stage;
 
-            if (pst != nst)
-            {
-                if (ett == ALL_TRANSITIONS || (nst == ENVT::s_attack && ett == START_ATTACK) ||
-                    (nst == ENVT::s_decay && ett == START_DECAY) ||
-                    (nst == ENVT::s_sustain && !getMode() && ett == START_SUSTAIN) ||
-                    (nst == ENVT::s_sustain && getMode() && ett == START_HOLD) ||
-                    (nst == ENVT::s_release && ett == START_RELEASE) ||
-                    (nst > ENVT::s_release && ett == EO_CYCLE))
-                {
-                    eocCountdown[c] = eocInit;
-                }
-            }
-            else
-            {
-                if (eocCountdown[c])
-                    eocCountdown[c]--;
-            }
+            auto fire = pst != nst &&
+                        (ett == ALL_TRANSITIONS || (nst == ENVT::s_attack && ett == START_ATTACK) ||
+                         (nst == ENVT::s_decay && ett == START_DECAY) ||
+                         (nst == ENVT::s_sustain && !mode && ett == START_SUSTAIN) ||
+                         (nst == ENVT::s_sustain && mode && ett == START_HOLD) ||
+                         (nst == ENVT::s_release && ett == START_RELEASE) ||
+                         (nst > ENVT::s_release && ett == EO_CYCLE));
+            eocFire[c] = fire ? -1 : 0;
+            eocHeld[c] = pst == nst ? -1 : 0;
+
+            envOut[c] = procs[c]->output;
+            envOutCubed[c] = procs[c]->outputCubed;
+        }
+
+        const auto one = _mm_set1_ps(1.f);
+        const auto ten = _mm_set1_ps(10.f);
+        const auto initI = _mm_set1_epi32(eocInit);
+        const auto zeroI = _mm_setzero_si128();
+        for (int c = 0; c < nChan; c += 4)
+        {
+            auto cd = _mm_load_si128((const __m128i *)&eocCountdown[c]);
+            auto fire = _mm_load_si128((const __m128i *)&eocFire[c]);
+            auto held = _mm_load_si128((const __m128i *)&eocHeld[c]);
+            // held voices count down to zero by adding the -1 mask of the ones still running
+            cd = _mm_add_epi32(cd, _mm_and_si128(held, _mm_cmpgt_epi32(cd, zeroI)));
+            cd = _mm_or_si128(_mm_and_si128(fire, initI), _mm_andnot_si128(fire, cd));
+            _mm_store_si128((__m128i *)&eocCountdown[c], cd);
+
+            auto on = _mm_castsi128_ps(_mm_cmpgt_epi32(cd, zeroI));
+            _mm_storeu_ps(outputs[EOC_OUT].getVoltages(c), _mm_and_ps(on, ten));
         }
 
         // ToDo - SIMDize
@@ -621,45 +724,38 @@ struct EGxVCA : modules::XTModule, sst::rackhelpers::module_connector::NeighborC
             meterUpdateCount = 0;
         }
 
-        for (int c = 0; c < nChan; ++c)
+        for (int c = 0; c < nChan; c += 4)
         {
-            auto o1 = procs[c]->output;
-            auto o3 = procs[c]->outputCubed;
-            auto r = response[c].target;
-            auto o = (1 - r) * o1 + r * o3;
-
-            auto l = level[c].target;
-            auto ol = o * l;
+            auto o1 = _mm_load_ps(&envOut[c]);
+            auto o3 = _mm_load_ps(&envOutCubed[c]);
+            auto r = response.get(c);
+            auto o = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(one, r), o1), _mm_mul_ps(r, o3));
 
-            auto lV = inputs[INPUT_L].getVoltage(c) * ol;
-            auto rV = inputs[INPUT_R].getVoltage(c) * ol;
+            auto ol = _mm_mul_ps(o, level.get(c));
 
-            auto nlV = lV * pan[c][0].target + rV * pan[c][2].target;
-            auto nrV = rV * pan[c][1].target + lV * pan[c][3].target;
+            auto lV = _mm_mul_ps(_mm_loadu_ps(inputs[INPUT_L].getVoltages(c)), ol);
+            auto rV = _mm_mul_ps(_mm_loadu_ps(inputs[INPUT_R].getVoltages(c)), ol);
 
-            outputs[ENV_OUT].setVoltage(o1 * 10, c);
-            outputs[EOC_OUT].setVoltage((eocCountdown[c] != 0) * 10, c);
-            outputs[OUTPUT_L].setVoltage(nlV, c);
-            outputs[OUTPUT_R].setVoltage(nrV, c);
+            auto nlV = _mm_add_ps(_mm_mul_ps(lV, pan[0].get(c)), _mm_mul_ps(rV, pan[2].get(c)));
+            auto nrV = _mm_add_ps(_mm_mul_ps(rV, pan[1].get(c)), _mm_mul_ps(lV, pan[3].get(c)));
 
-            // even at 16-way egxvca this takes 1% of the cpu but still we could probably
-            // make these steps simd operations to save a smidge one day
-            level[c].step();
-            response[c].step();
+            _mm_storeu_ps(outputs[ENV_OUT].getVoltages(c), _mm_mul_ps(o1, ten));
+            _mm_storeu_ps(outputs[OUTPUT_L].getVoltages(c), nlV);
+            _mm_storeu_ps(outputs[OUTPUT_R].getVoltages(c), nrV);
 
+            level.step(c);
+            response.step(c);
             for (int q = 0; q < 4; ++q)
-                pan[c][q].step();
+                pan[q].step(c);
         }
         processCount++;
     }
 
-    bool lastSlow{false};
     bool isSlow()
     {
         auto s = (bool)std::round(getParam(FAST_OR_SLOW).getValue());
         return s;
     }
-    bool lastMode{0};
     bool getMode()
     {
         auto s = (bool)std::round(getParam(ADSR_OR_DAHD).getValue());
@@ -667,52 +763,61 @@ struct EGxVCA : modules::XTModule, sst::rackhelpers::module_connector::NeighborC
     }
     void process(const typename rack::Module::ProcessArgs &args) override
     {
-        auto s = isSlow();
-        if (s != lastSlow)
-        {
-            resetEnvelopes();
-            lastSlow = s;
-        }
-        auto m = getMode();
-        if (m != lastMode)
-        {
-            resetEnvelopes();
-            lastMode = m;
-        }
-        if (m == 0)
-        {
-            if (s)
-                processFastSlow(args, processorsAdsrSlow);
-            else
-                processFastSlow(args, processorsAdsr);
-        }
-        else
-        {
-            if (s)
-                processFastSlow(args, processorsDahdSlow);
-            else
-                processFastSlow(args, processorsDahd);
-        }
+        auto f = envelopeFlavour();
+        if (f != envelopes->flavour)
+            adoptEnvelopes(f);
+
+        envelopes->visit([this, &args](auto &bank) { processFastSlow(args, bank); });
     }
 
-    void resetEnvelopes()
+    /*
+     * Audio thread. Take the pending set if it is the flavour the switches ask for and the
+     * UI has freed the last retired one; otherwise keep running the current set.
+     */
+    void adoptEnvelopes(int f)
     {
-        for (const auto &p : processorsAdsr)
-        {
-            p->immediatelySilence();
-        }
-        for (const auto &p : processorsAdsrSlow)
-        {
-            p->immediatelySilence();
-        }
-        for (const auto &p : processorsDahd)
-        {
-            p->immediatelySilence();
-        }
-        for (const auto &p : processorsDahdSlow)
+        auto *p = pendingEnvelopes.load(std::memory_order_acquire);
+        if (!p || p->flavour != f || retiredEnvelopes.load(std::memory_order_acquire))
+            return;
+        if (!pendingEnvelopes.compare_exchange_strong(p, nullptr, std::memory_order_acq_rel))
+            return;
+
+        p->visit([](auto &bank) {
+            for (int i = 0; i < MAX_POLY; ++i)
+            {
+                bank[i]->onSampleRateChanged();
+                bank[i]->immediatelySilence();
+            }
+        });
+        retiredEnvelopes.store(envelopes.release(), std::memory_order_release);
+        envelopes.reset(p);
+        activeFlavour.store(f, std::memory_order_release);
+        updateTimeRanges();
+    }
+
+    /*
+     * UI thread. Free whatever the audio thread retired and make sure a set for the switch
+     * positions is waiting if the active one doesn't match them.
+     */
+    void updateEnvelopeSet()
+    {
+        delete retiredEnvelopes.exchange(nullptr, std::memory_order_acq_rel);
+
+        auto want = envelopeFlavour();
+        auto active = activeFlavour.load(std::memory_order_acquire);
+        auto *p = pendingEnvelopes.exchange(nullptr, std::memory_order_acq_rel);
+        if (p && (p->flavour != want || p->flavour == active))
         {
-            p->immediatelySilence();
+            delete p;
+            p = nullptr;
         }
+        if (!p && want != active)
+            p = new EnvelopeSet(storage.get(), want);
+        pendingEnvelopes.store(p, std::memory_order_release);
+    }
+
+    void updateTimeRanges()
+    {
         auto s = isSlow();
         for (auto pqi : {EG_A, EG_D, EG_S, EG_R})
         {
@@ -744,7 +849,11 @@ struct EGxVCA : modules::XTModule, sst::rackhelpers::module_connector::NeighborC
         return vc;
     }
 
-    void readModuleSpecificJson(json_t *modJ) override { clockProc.fromJson(modJ); }
+    void readModuleSpecificJson(json_t *modJ) override
+    {
+        clockProc.fromJson(modJ);
+        updateEnvelopeSet();
+    }
 };
 } // namespace sst::surgext_rack::egxvca
 #endif
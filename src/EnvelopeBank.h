@@ -0,0 +1,74 @@
+/*
+ * SurgeXT for VCV Rack - a Surge Synth Team product
+ *
+ * A set of modules expressing Surge XT into the VCV Rack Module Ecosystem
+ *
+ * Copyright 2019 - 2024, Various authors, as described in the github
+ * transaction log.
+ *
+ * Surge XT for VCV Rack is released under the GNU General Public License
+ * 3.0 or later (GPL-3.0-or-later). A copy of the license is in this
+ * repository in the file "LICENSE" or at:
+ *
+ * or at https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * All source for Surge XT for VCV Rack is available at
+ * https://github.com/surge-synthesizer/surge-rack/
+ */
+
+#ifndef SURGE_XT_RACK_SRC_ENVELOPEBANK_H
+#define SURGE_XT_RACK_SRC_ENVELOPEBANK_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <new>
+
+#include "SurgeXT.h"
+
+namespace sst::surgext_rack::modules
+{
+/*
+ * MAX_POLY envelopes constructed side by side in one block rather than as separate
+ * heap objects, so stepping a voice bank walks contiguous memory. Indexing gives a
+ * pointer so call sites read the same as an array of unique_ptrs.
+ */
+template <typename ENVT> struct EnvelopeBank
+{
+    typedef ENVT envelope_t;
+
+    EnvelopeBank() = default;
+    explicit EnvelopeBank(SurgeStorage *s) { setup(s); }
+    EnvelopeBank(const EnvelopeBank &) = delete;
+    EnvelopeBank &operator=(const EnvelopeBank &) = delete;
+    ~EnvelopeBank() { teardown(); }
+
+    void setup(SurgeStorage *s)
+    {
+        teardown();
+        for (int c = 0; c < MAX_POLY; ++c)
+            envs[c] = new (buffer[c]) envelope_t(s);
+    }
+
+    envelope_t *operator[](int c) const { return envs[c]; }
+
+    bool isSetup() const { return envs[0] != nullptr; }
+
+  private:
+    void teardown()
+    {
+        for (int c = 0; c < MAX_POLY; ++c)
+        {
+            if (envs[c])
+                envs[c]->~envelope_t();
+            envs[c] = nullptr;
+        }
+    }
+
+    // sizeof is a multiple of alignof, so aligning the block aligns every slot
+    alignas(std::max<std::size_t>(16, alignof(envelope_t))) unsigned char
+        buffer[MAX_POLY][sizeof(envelope_t)];
+    std::array<envelope_t *, MAX_POLY> envs{};
+};
+} // namespace sst::surgext_rack::modules
+#endif
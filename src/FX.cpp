@@ -21,6 +21,7 @@
 #include "XTModuleWidget.h"
 #include "XTWidgets.h"
 #include "SurgeXT.h"
+#include "osdialog.h"
 
 namespace sst::surgext_rack::fx::ui
 {
@@ -58,6 +59,14 @@ template <int fxType> struct FXWidget : public widgets::XTModuleWidget
 
             menu->addChild(rack::createMenuItem("Polyphonic Stereo Processing", CHECKMARK(t),
                                                 [xtm] { xtm->polyphonicMode = true; }));
+
+            if constexpr (FXConfig<fxType>::allowsParallelVoices())
+            {
+                bool pv = xtm->parallelVoices;
+                menu->addChild(rack::createMenuItem("Spread Polyphonic Voices Across Cores",
+                                                    CHECKMARK(pv),
+                                                    [xtm, pv] { xtm->setParallelVoices(!pv); }));
+            }
         }
 
         if (FXConfig<fxType>::usesClock())
@@ -72,7 +81,7 @@ template <int fxType> struct FXWidget : public widgets::XTModuleWidget
 template <int fxType> struct FXPresetSelector : widgets::PresetJogSelector
 {
     FX<fxType> *module{nullptr};
-    Surge::Storage::FxUserPreset::Preset *currentPreset{nullptr};
+    const Surge::Storage::FxUserPreset::Preset *currentPreset{nullptr};
     static FXPresetSelector *create(FX<fxType> *module)
     {
         auto res = new FXPresetSelector<fxType>();
@@ -87,7 +96,7 @@ template <int fxType> struct FXPresetSelector : widgets::PresetJogSelector
 
         if (module && res->module->loadedPreset >= 0)
         {
-            res->currentPreset = &res->module->presets[res->module->loadedPreset];
+            res->currentPreset = &(*res->module->presets)[res->module->loadedPreset];
             res->id = res->module->loadedPreset;
         }
 
@@ -100,24 +109,24 @@ template <int fxType> struct FXPresetSelector : widgets::PresetJogSelector
         id = i;
         if (!module)
             return;
-        if (module->presets.empty())
+        if (module->presets->empty())
             return;
 
         module->loadPreset(id);
-        currentPreset = &module->presets[id];
+        currentPreset = &(*module->presets)[id];
         forceDirty = true;
     }
     void onPresetJog(int dir /* +/- 1 */) override
     {
         if (!module)
             return;
-        if (module->presets.empty())
+        if (module->presets->empty())
             return;
 
         id += dir;
         if (id < 0)
-            id = module->presets.size() - 1;
-        if (id >= (int)module->presets.size())
+            id = module->presets->size() - 1;
+        if (id >= (int)module->presets->size())
             id = 0;
         forceDirty = true;
         setValue(id);
@@ -126,29 +135,70 @@ template <int fxType> struct FXPresetSelector : widgets::PresetJogSelector
     {
         if (!module)
             return;
+        module->refreshPresetTable();
+        // the table may have been rebuilt so don't hold a pointer into the old one
+        if (module->loadedPreset >= 0 && module->loadedPreset < (int)module->presets->size())
+            currentPreset = &(*module->presets)[module->loadedPreset];
+        else
+            currentPreset = nullptr;
         auto menu = rack::createMenu();
         auto psn = std::string(fx_type_names[fxType]) + " Presets";
         menu->addChild(rack::createMenuLabel(psn));
 
         int idx{0};
-        for (const auto &p : module->presets)
+        for (const auto &p : *module->presets)
         {
             menu->addChild(rack::createMenuItem(p.name, "", [this, idx]() { setValue(idx); }));
             idx++;
         }
+
+        menu->addChild(new rack::ui::MenuSeparator);
+        auto m = module;
+        menu->addChild(rack::createMenuItem("Save User Preset", "", [m]() {
+#ifdef USING_CARDINAL_NOT_RACK
+            async_dialog_text_input("Preset Name", "", [=](char *name) {
+                if (name)
+                {
+                    DEFER({ std::free(name); });
+                    saveUserPreset(m, name);
+                }
+            });
+#else
+            char *name = osdialog_prompt(OSDIALOG_INFO, "Preset Name", "");
+            if (name)
+            {
+                DEFER({ std::free(name); });
+                saveUserPreset(m, name);
+            }
+#endif
+        }));
+        menu->addChild(rack::createMenuItem("Rescan User Presets", "", [m]() {
+            FX<fxType>::invalidatePresetTable();
+            m->refreshPresetTable();
+        }));
+    }
+
+    static void saveUserPreset(FX<fxType> *m, const std::string &name)
+    {
+        if (name.empty())
+            return;
+        // fxstorage holds the unmodulated knob values, which is what a preset records
+        m->storage->fxUserPreset->saveFxIn(m->storage.get(), m->fxstorage, name);
+        FX<fxType>::invalidatePresetTable();
+        m->refreshPresetTable();
     }
     std::string getPresetName() override
     {
         if (!module)
             return "";
-        if (module->presets.empty())
+        if (module->presets->empty())
             return "";
         if (module->maxPresets == 0)
             return "";
         if (module->maxPresets <= id || id < 0)
             return "Software Error";
 
-        auto res = module->presets[id].name;
+        auto res = (*module->presets)[id].name;
         if (module->presetIsDirty)
             res += "*";
         return res;
@@ -158,7 +208,7 @@ template <int fxType> struct FXPresetSelector : widgets::PresetJogSelector
     bool forceDirty{true};
     bool isDirty() override
     {
-        if (module && !module->presets.empty() && currentPreset && checkPresetEvery == 0 &&
+        if (module && !module->presets->empty() && currentPreset && checkPresetEvery == 0 &&
             !module->presetIsDirty)
         {
             for (int i = 0; i < n_fx_params; ++i)
@@ -189,7 +239,7 @@ template <int fxType> struct FXPresetSelector : widgets::PresetJogSelector
         if (checkPresetEvery >= 8)
             checkPresetEvery = 0;
 
-        if (module && !module->presets.empty())
+        if (module && !module->presets->empty())
         {
             if (module->loadedPreset >= 0 && module->loadedPreset != id)
             {
@@ -210,7 +260,7 @@ template <int fxType> struct FXPresetSelector : widgets::PresetJogSelector
     bool hasPresets() override
     {
         if (module)
-            return !module->presets.empty();
+            return !module->presets->empty();
         return module != nullptr;
     }
 };
@@ -28,6 +28,7 @@
 
 #include "DebugHelpers.h"
 #include "FxPresetAndClipboardManager.h"
+#include "VoiceWorkerPool.h"
 
 #include "LayoutEngine.h"
 #include "sst/rackhelpers/neighbor_connectable.h"
@@ -73,6 +74,13 @@ template <int fxType> struct FXConfig
     static constexpr bool usesPresets() { return true; }
     static constexpr int numParams() { return n_fx_params; }
     static constexpr bool allowsPolyphony() { return true; }
+    /*
+     * Poly voices may run on worker threads only for effects vetted to touch nothing shared
+     * while processing: not the storage RNG, not the sideband buffers and not the per voice
+     * storage the extra inputs set. Anything else could make the parallel output differ
+     * from the serial one, so each config opts in explicitly.
+     */
+    static constexpr bool allowsParallelVoices() { return false; }
 
     static constexpr float rescaleInputFactor() { return 1.0; }
     static constexpr bool softclipOutput() { return false; }
@@ -130,7 +138,6 @@ struct FX : modules::XTModule, sst::rackhelpers::module_connector::NeighborConne
 
     FX() : XTModule(), halfbandIN(6, true)
     {
-        std::lock_guard<std::mutex> lgxt(xtSurgeCreateMutex);
         setupSurge();
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
@@ -225,7 +232,8 @@ struct FX : modules::XTModule, sst::rackhelpers::module_connector::NeighborConne
     float modScales[n_fx_params];
     std::atomic<int> loadedPreset{-1}, maxPresets{0};
     std::atomic<bool> presetIsDirty{false};
-    std::vector<Surge::Storage::FxUserPreset::Preset> presets;
+    typedef std::vector<Surge::Storage::FxUserPreset::Preset> presetTable_t;
+    std::shared_ptr<const presetTable_t> presets{std::make_shared<const presetTable_t>()};
 
     std::atomic<bool> polyphonicMode{false};
 
@@ -245,6 +253,7 @@ struct FX : modules::XTModule, sst::rackhelpers::module_connector::NeighborConne
 
         setupStorageRanges(&(fxstorage->type), &(fxstorage->p[n_fx_params - 1]));
         copyGlobaldataSubset(storage_id_start, storage_id_end);
+        polyBaseGlobaldata.resize(std::max(0, storage_id_end - storage_id_start));
 
         surge_effect.reset(
             spawn_effect(fxType, storage.get(), fxstorage, storage->getPatch().globaldata));
@@ -263,57 +272,105 @@ struct FX : modules::XTModule, sst::rackhelpers::module_connector::NeighborConne
         memset(processedL, 0, sizeof(float) * MAX_POLY * BLOCK_SIZE);
         memset(processedR, 0, sizeof(float) * MAX_POLY * BLOCK_SIZE);
 
+        refreshPresetTable();
+    }
+
+    void refreshPresetTable()
+    {
         if (FXConfig<fxType>::usesPresets())
         {
-            auto sect = storage->getSnapshotSection("fx");
-            if (sect)
+            presets = presetTableFor(storage.get(), fxstorage);
+            maxPresets = presets->size();
+        }
+    }
+
+    /*
+     * The factory presets for a type come from the configuration snapshot section and the
+     * user presets from the user preset scan. Neither changes per instance, so we build the
+     * table once per type on first use and every instance of that type holds the same
+     * immutable vector.
+     */
+    static std::mutex &presetTableMutex()
+    {
+        static std::mutex m;
+        return m;
+    }
+    static std::shared_ptr<const presetTable_t> &presetTableSlot()
+    {
+        static std::shared_ptr<const presetTable_t> slot;
+        return slot;
+    }
+
+    // Call when a user preset for this type is saved; instances pick it up on the next
+    // presetTableFor call and existing holders keep the old table alive until then
+    static void invalidatePresetTable()
+    {
+        std::lock_guard<std::mutex> lg(presetTableMutex());
+        presetTableSlot().reset();
+        invalidateUserFXPresets();
+    }
+
+    static std::shared_ptr<const presetTable_t> presetTableFor(SurgeStorage *storage,
+                                                               FxStorage *fxstorage)
+    {
+        std::lock_guard<std::mutex> lg(presetTableMutex());
+        auto &slot = presetTableSlot();
+        if (slot)
+            return slot;
+
+        auto res = std::make_shared<presetTable_t>();
+        auto sect = storage->getSnapshotSection("fx");
+        if (sect)
+        {
+            auto type = sect->FirstChildElement();
+            while (type)
             {
-                auto type = sect->FirstChildElement();
-                while (type)
-                {
-                    int i;
+                int i;
 
-                    if (type->Value() && strcmp(type->Value(), "type") == 0 &&
-                        type->QueryIntAttribute("i", &i) == TIXML_SUCCESS && i == fxType)
+                if (type->Value() && strcmp(type->Value(), "type") == 0 &&
+                    type->QueryIntAttribute("i", &i) == TIXML_SUCCESS && i == fxType)
+                {
+                    auto kid = type->FirstChildElement();
+                    while (kid)
                     {
-                        auto kid = type->FirstChildElement();
-                        while (kid)
+                        if (strcmp(kid->Value(), "snapshot") == 0)
                         {
-                            if (strcmp(kid->Value(), "snapshot") == 0)
+                            auto p = Surge::Storage::FxUserPreset::Preset();
+                            p.type = fxType;
+                            for (int q = 0; q < n_fx_params; ++q)
                             {
-                                auto p = Surge::Storage::FxUserPreset::Preset();
-                                p.type = fxType;
-                                for (int q = 0; q < n_fx_params; ++q)
+                                // Set up with default values remember q index. Use the
+                                // defaults not the values since a rebuild may happen after
+                                // the user has moved the knobs
+                                if (fxstorage->p[q].valtype == vt_float)
+                                {
+                                    p.p[q] = fxstorage->p[q].val_default.f;
+                                }
+                                if (fxstorage->p[q].valtype == vt_int)
                                 {
-                                    // Set up with default values remember q index
-                                    if (fxstorage->p[q].valtype == vt_float)
-                                    {
-                                        p.p[q] = fxstorage->p[q].val.f;
-                                    }
-                                    if (fxstorage->p[q].valtype == vt_int)
-                                    {
-                                        p.p[q] = fxstorage->p[q].val.i;
-                                    }
-                                    if (fxstorage->p[q].valtype == vt_bool)
-                                    {
-                                        p.p[q] = fxstorage->p[q].val.b;
-                                    }
+                                    p.p[q] = fxstorage->p[q].val_default.i;
+                                }
+                                if (fxstorage->p[q].valtype == vt_bool)
+                                {
+                                    p.p[q] = fxstorage->p[q].val_default.b;
                                 }
-                                storage->fxUserPreset->readFromXMLSnapshot(p, kid);
-                                p.isFactory = true;
-                                presets.push_back(p);
                             }
-                            kid = kid->NextSiblingElement();
+                            storage->fxUserPreset->readFromXMLSnapshot(p, kid);
+                            p.isFactory = true;
+                            res->push_back(p);
                         }
+                        kid = kid->NextSiblingElement();
                     }
-                    type = type->NextSiblingElement();
                 }
+                type = type->NextSiblingElement();
             }
-            auto xtrapresets = storage->fxUserPreset->getPresetsForSingleType(fxType);
-            for (auto p : xtrapresets)
-                presets.push_back(p);
-            maxPresets = presets.size();
         }
+        auto xtrapresets = userFXPresetsForType(storage, fxType);
+        for (auto p : xtrapresets)
+            res->push_back(p);
+
+        slot = res;
+        return slot;
     }
 
     Parameter *surgeDisplayParameterForParamId(int paramId) override
@@ -434,7 +491,7 @@ struct FX : modules::XTModule, sst::rackhelpers::module_connector::NeighborConne
             APP->history->push(h);
         }
 
-        const auto &ps = presets[which];
+        const auto &ps = (*presets)[which];
 
         for (int i = 0; i < n_fx_params; ++i)
         {
@@ -642,6 +699,26 @@ struct FX : modules::XTModule, sst::rackhelpers::module_connector::NeighborConne
 
     int lastNChan{-1};
 
+    std::vector<pdata> polyBaseGlobaldata;
+    void snapshotPolyBaseGlobaldata()
+    {
+        const auto &pt = storage->getPatch().globaldata;
+        std::copy(&pt[storage_id_start], &pt[storage_id_end], polyBaseGlobaldata.begin());
+    }
+
+    static constexpr float silenceThreshold{1e-5f};
+    static bool blockIsSilent(const float *l, const float *r)
+    {
+        auto mx = _mm_setzero_ps();
+        const auto sm = _mm_set1_ps(-0.f);
+        for (int i = 0; i < BLOCK_SIZE; i += 4)
+        {
+            mx = _mm_max_ps(mx, _mm_andnot_ps(sm, _mm_load_ps(l + i)));
+            mx = _mm_max_ps(mx, _mm_andnot_ps(sm, _mm_load_ps(r + i)));
+        }
+        return _mm_movemask_ps(_mm_cmpgt_ps(mx, _mm_set1_ps(silenceThreshold))) == 0;
+    }
+
     void reinitialize(int c = -1)
     {
         if (c == -1)
@@ -662,11 +739,13 @@ struct FX : modules::XTModule, sst::rackhelpers::module_connector::NeighborConne
             memset(processedR, 0, sizeof(float) * MAX_POLY * BLOCK_SIZE);
             memset(bufferL, 0, sizeof(float) * MAX_POLY * BLOCK_SIZE);
             memset(bufferR, 0, sizeof(float) * MAX_POLY * BLOCK_SIZE);
+            memset(polySilentBlocks, 0, sizeof(polySilentBlocks));
         }
         else
         {
             // poly nan case
             surge_effect_poly[c]->init();
+            polySilentBlocks[c] = 0;
 
             // Other buffers are fine. Just clear mine. And don't change
             // pos since the zeros wont hurt me.
@@ -677,19 +756,124 @@ struct FX : modules::XTModule, sst::rackhelpers::module_connector::NeighborConne
         }
     }
 
+    /*
+     * Each poly voice reads its parameters from its own copy of the globaldata, so the
+     * voices are independent of each other once their block is prepared. That is what
+     * lets them run on the worker pool and still produce exactly the serial output.
+     */
+    pdata polyGlobaldata alignas(16)[MAX_POLY][n_global_params];
+    bool polyInputPresent[MAX_POLY]{};
+
+    /*
+     * A poly voice goes to sleep once its input and its output have both been below
+     * silenceThreshold for a run of blocks, and wakes as soon as its input comes back. A
+     * sleeping voice skips the effect entirely, control update included, and outputs
+     * silence. The run is never shorter than the effect's own ringout time, so a delay with
+     * a long time still gets its echo out; effects which don't know their tail wait longer.
+     */
+    static constexpr float sleepAfterSilentSeconds{0.25f}, sleepAfterSilentSecondsNoTail{5.f};
+    uint32_t polySilentBlocks[MAX_POLY]{};
+
+    uint32_t silentBlocksToSleep(Effect *e)
+    {
+        auto d = e->get_ringout_decay();
+        auto s = (d < 0) ? sleepAfterSilentSecondsNoTail : sleepAfterSilentSeconds;
+        auto n = (uint32_t)(storage->samplerate * s / BLOCK_SIZE);
+        return (d < 0) ? n : std::max(n, (uint32_t)d);
+    }
+
     void guaranteePolyFX(int chan)
     {
         for (int i = 0; i < chan; ++i)
         {
             if (!surge_effect_poly[i])
             {
+                std::memcpy(polyGlobaldata[i], storage->getPatch().globaldata,
+                            sizeof(polyGlobaldata[i]));
                 surge_effect_poly[i].reset(
-                    spawn_effect(fxType, storage.get(), fxstorage, storage->getPatch().globaldata));
+                    spawn_effect(fxType, storage.get(), fxstorage, polyGlobaldata[i]));
                 surge_effect_poly[i]->init();
             }
+            if constexpr (FXConfig<fxType>::usesSidebandOversampled())
+            {
+                if (!halfbandINPoly[i])
+                    halfbandINPoly[i] =
+                        std::make_unique<sst::filters::HalfRate::HalfRateFilter>(6, true);
+            }
+        }
+    }
+
+    // The storage sideband buffers are shared so the sideband FX never run in parallel
+    bool polySideband{false};
+    std::array<std::unique_ptr<sst::filters::HalfRate::HalfRateFilter>, MAX_POLY> halfbandINPoly;
+    void loadSidebandForVoice(int c, sst::filters::HalfRate::HalfRateFilter *hb)
+    {
+        std::memcpy(storage->audio_in_nonOS[0], modulatorL[c], BLOCK_SIZE * sizeof(float));
+        std::memcpy(storage->audio_in_nonOS[1], modulatorR[c], BLOCK_SIZE * sizeof(float));
+        if constexpr (FXConfig<fxType>::usesSidebandOversampled())
+        {
+            hb->process_block_U2(modulatorL[c], modulatorR[c], storage->audio_in[0],
+                                 storage->audio_in[1], BLOCK_SIZE_OS);
+        }
+    }
+
+    void processPolyVoices(int from, int to)
+    {
+        for (int c = from; c < to; ++c)
+        {
+            auto *fx = surge_effect_poly[c].get();
+            if (polyInputPresent[c])
+            {
+                polySilentBlocks[c] = 0;
+            }
+            else if (polySilentBlocks[c] >= silentBlocksToSleep(fx))
+            {
+                std::memset(processedL[c], 0, BLOCK_SIZE * sizeof(float));
+                std::memset(processedR[c], 0, BLOCK_SIZE * sizeof(float));
+                FXConfig<fxType>::populateExtraOutputs(this, c, fx);
+                continue;
+            }
+
+            fx->process_ringout(processedL[c], processedR[c], polyInputPresent[c]);
+            FXConfig<fxType>::populateExtraOutputs(this, c, fx);
+
+            if (!polyInputPresent[c] && blockIsSilent(processedL[c], processedR[c]))
+                polySilentBlocks[c]++;
+            else
+                polySilentBlocks[c] = 0;
         }
     }
 
+    static void processPolyVoicesJob(void *that, int from, int to)
+    {
+        static_cast<FX<fxType> *>(that)->processPolyVoices(from, to);
+    }
+
+    static_assert(!FXConfig<fxType>::allowsParallelVoices() ||
+                      (!FXConfig<fxType>::usesSideband() && FXConfig<fxType>::extraInputs() == 0),
+                  "Parallel poly voices can't share the sideband or the extra input storage");
+
+    // Opt in since it trades a thread hop per block for spreading heavy voices across cores
+    std::atomic<bool> parallelVoices{false};
+    // UI thread. Once held the pool reference is kept until the module goes away, so the
+    // audio thread can never be inside the pool when it is released
+    bool holdsVoiceWorkerPool{false};
+    void setParallelVoices(bool b)
+    {
+        if (b && !holdsVoiceWorkerPool)
+        {
+            modules::VoiceWorkerPool::acquire();
+            holdsVoiceWorkerPool = true;
+        }
+        parallelVoices = b;
+    }
+
+    ~FX()
+    {
+        if (holdsVoiceWorkerPool)
+            modules::VoiceWorkerPool::release();
+    }
+
     void processPoly(const typename rack::Module::ProcessArgs &args)
     {
         static constexpr float scaleFac{FXConfig<fxType>::rescaleInputFactor()},
@@ -727,19 +911,41 @@ struct FX : modules::XTModule, sst::rackhelpers::module_connector::NeighborConne
             }
         }
 
-        // FIXME make this poly
         if constexpr (FXConfig<fxType>::usesSideband())
         {
+            /*
+             * A polyphonic sideband feeds each voice its own channel. A monophonic one is
+             * collected (and oversampled) once and shared by every voice, as in mono mode.
+             */
+            auto sbChans =
+                std::max(inputs[SIDEBAND_L].getChannels(), inputs[SIDEBAND_R].getChannels());
+            bool wasPolySideband = polySideband;
+            polySideband = sbChans > 1;
+            if (polySideband && !wasPolySideband)
+            {
+                for (auto &h : halfbandINPoly)
+                    if (h)
+                        h->reset();
+            }
+
+            auto rsb = SIDEBAND_R;
             if (inputs[SIDEBAND_L].isConnected() && !inputs[SIDEBAND_R].isConnected())
+                rsb = SIDEBAND_L;
+
+            if (polySideband)
             {
-                float ml = inputs[SIDEBAND_L].getVoltageSum();
-                modulatorL[0][bufferPos] = ml;
-                modulatorR[0][bufferPos] = ml;
+                for (int c = 0; c < chan; ++c)
+                {
+                    modulatorL[c][bufferPos] =
+                        inputs[SIDEBAND_L].getVoltage(c) * RACK_TO_SURGE_OSC_MUL;
+                    modulatorR[c][bufferPos] = inputs[rsb].getVoltage(c) * RACK_TO_SURGE_OSC_MUL;
+                }
             }
             else
             {
-                modulatorL[0][bufferPos] = inputs[SIDEBAND_L].getVoltageSum();
-                modulatorR[0][bufferPos] = inputs[SIDEBAND_R].getVoltageSum();
+                modulatorL[0][bufferPos] =
+                    inputs[SIDEBAND_L].getVoltageSum() * RACK_TO_SURGE_OSC_MUL;
+                modulatorR[0][bufferPos] = inputs[rsb].getVoltageSum() * RACK_TO_SURGE_OSC_MUL;
             }
         }
 
@@ -760,6 +966,39 @@ struct FX : modules::XTModule, sst::rackhelpers::module_connector::NeighborConne
                 fxstorage->p[i].set_value_f01(polyModAssist.basevalues[i]);
             }
 
+            // The unmodulated values are the same for every voice so build them once
+            copyGlobaldataSubset(storage_id_start, storage_id_end);
+            snapshotPolyBaseGlobaldata();
+
+            int nModulated{0};
+            int modulatedIdx[FXConfig<fxType>::numParams()];
+            for (int i = 0; i < FXConfig<fxType>::numParams(); ++i)
+            {
+                if (polyModAssist.connectedParameter[i] && fxstorage->p[i].valtype == vt_float)
+                    modulatedIdx[nModulated++] = i;
+            }
+
+            bool extraInputsActive{false};
+            for (int i = 0; i < FXConfig<fxType>::extraInputs(); ++i)
+                extraInputsActive = extraInputsActive || inputs[INPUT_SPECIFIC_0 + i].isConnected();
+            if constexpr (FXConfig<fxType>::usesSideband())
+                extraInputsActive = extraInputsActive || inputs[SIDEBAND_L].isConnected() ||
+                                    inputs[SIDEBAND_R].isConnected();
+
+            if constexpr (FXConfig<fxType>::usesSideband())
+            {
+                if (!polySideband)
+                    loadSidebandForVoice(0, &halfbandIN);
+            }
+
+            modules::VoiceWorkerPool *pool{nullptr};
+            if constexpr (FXConfig<fxType>::allowsParallelVoices())
+            {
+                if (parallelVoices && chan > 1)
+                    pool = modules::VoiceWorkerPool::existing();
+            }
+
+            auto nBase = polyBaseGlobaldata.size();
             for (int c = 0; c < chan; ++c)
             {
                 FXConfig<fxType>::processExtraInputs(this, c);
@@ -767,33 +1006,40 @@ struct FX : modules::XTModule, sst::rackhelpers::module_connector::NeighborConne
                 std::memcpy(processedL[c], bufferL[c], BLOCK_SIZE * sizeof(float));
                 std::memcpy(processedR[c], bufferR[c], BLOCK_SIZE * sizeof(float));
 
-                if constexpr (FXConfig<fxType>::usesSideband())
+                if constexpr (FXConfig<fxType>::extraInputs() > 0)
                 {
-                    std::memcpy(storage->audio_in_nonOS[0], modulatorL, BLOCK_SIZE * sizeof(float));
-                    std::memcpy(storage->audio_in_nonOS[1], modulatorR, BLOCK_SIZE * sizeof(float));
+                    // Extra inputs can change the storage per voice so re-copy for this one
+                    copyGlobaldataSubset(storage_id_start, storage_id_end);
+                    snapshotPolyBaseGlobaldata();
                 }
 
-                copyGlobaldataSubset(storage_id_start, storage_id_end);
-
-                auto *oap = &fxstorage->p[0];
-                auto *eap = &fxstorage->p[FXConfig<fxType>::numParams() - 1];
-                auto &pt = storage->getPatch().globaldata;
-                int idx = 0;
-                while (oap <= eap)
+                auto *vg = polyGlobaldata[c];
+                std::copy(polyBaseGlobaldata.data(), polyBaseGlobaldata.data() + nBase,
+                          &vg[storage_id_start]);
+                for (int m = 0; m < nModulated; ++m)
                 {
-                    if (oap->valtype == vt_float)
-                    {
-                        pt[oap->id].f += polyModAssist.modvalues[idx][c] * modScales[idx];
-                    }
-                    idx++;
-                    oap++;
+                    auto idx = modulatedIdx[m];
+                    auto id = fxstorage->p[idx].id;
+                    vg[id].f += polyModAssist.modvalues[idx][c] * modScales[idx];
                 }
 
-                surge_effect_poly[c]->process_ringout(processedL[c], processedR[c], true);
+                // Silent input feeds the ringout and the sleep count in processPolyVoices
+                polyInputPresent[c] =
+                    extraInputsActive || !blockIsSilent(bufferL[c], bufferR[c]);
+
+                if constexpr (FXConfig<fxType>::usesSideband())
+                {
+                    if (polySideband)
+                        loadSidebandForVoice(c, halfbandINPoly[c].get());
+                }
 
-                FXConfig<fxType>::populateExtraOutputs(this, c, surge_effect_poly[c].get());
+                if (!pool)
+                    processPolyVoices(c, c + 1);
             }
 
+            if (pool)
+                pool->run(&FX<fxType>::processPolyVoicesJob, this, chan);
+
             if constexpr (FXConfig<fxType>::nanCheckOutput())
             {
                 if (lastNanCheck == 0)
@@ -893,7 +1139,7 @@ struct FX : modules::XTModule, sst::rackhelpers::module_connector::NeighborConne
             {
                 json_object_set_new(fx, "loadedPreset", json_integer(loadedPreset));
                 json_object_set_new(fx, "presetName",
-                                    json_string(presets[loadedPreset].name.c_str()));
+                                    json_string((*presets)[loadedPreset].name.c_str()));
                 json_object_set_new(fx, "presetIsDirty", json_boolean(presetIsDirty));
             }
         }
@@ -905,6 +1151,8 @@ struct FX : modules::XTModule, sst::rackhelpers::module_connector::NeighborConne
         if (FXConfig<fxType>::allowsPolyphony())
         {
             json_object_set_new(fx, "polyphonicMode", json_boolean(polyphonicMode));
+            if (FXConfig<fxType>::allowsParallelVoices())
+                json_object_set_new(fx, "parallelVoices", json_boolean(parallelVoices));
         }
 
         // A little bit of defensive code I added in 2.2 in case we change int bounds in the
@@ -949,7 +1197,7 @@ struct FX : modules::XTModule, sst::rackhelpers::module_connector::NeighborConne
                 auto lpc = json_integer_value(lp);
                 auto pnc = std::string(json_string_value(pn));
                 auto pdc = json_boolean_value(pd);
-                if (lpc >= 0 && lpc < (int)presets.size() && presets[lpc].name == pnc)
+                if (lpc >= 0 && lpc < (int)presets->size() && (*presets)[lpc].name == pnc)
                 {
                     loadedPreset = lpc;
                     presetIsDirty = pdc;
@@ -969,6 +1217,12 @@ struct FX : modules::XTModule, sst::rackhelpers::module_connector::NeighborConne
                 auto pmv = json_boolean_value(pm);
                 polyphonicMode = pmv;
             }
+
+            if (FXConfig<fxType>::allowsParallelVoices())
+            {
+                auto pv = json_object_get(modJ, "parallelVoices");
+                setParallelVoices(pv && json_boolean_value(pv));
+            }
         }
     }
 
@@ -144,6 +144,8 @@ struct LFO : modules::XTModule
         setupSurgeCommon(NUM_PARAMS, false, false);
         for (int i = 0; i < MAX_POLY; ++i)
             surge_lfo[i] = std::make_unique<LFOModulationSource>();
+        memset(voiceScenedata, 0, sizeof(voiceScenedata));
+        memset(sharedScenedata, 0, sizeof(sharedScenedata));
 
         surge_ss = std::make_unique<StepSequencerStorage>();
         surge_ss->loop_start = 0;
@@ -248,8 +250,8 @@ struct LFO : modules::XTModule
 
         for (int i = 0; i < MAX_POLY; ++i)
         {
-            surge_lfo[i]->assign(storage.get(), lfostorage, storage->getPatch().scenedata[0],
-                                 nullptr, surge_ss.get(), surge_ms.get(), surge_fs.get());
+            surge_lfo[i]->assign(storage.get(), lfostorage, voiceScenedata[i], nullptr,
+                                 surge_ss.get(), surge_ms.get(), surge_fs.get());
 
             gateInputHigh[i] = false;
             gateEnvInputHigh[i] = false;
@@ -353,6 +355,89 @@ struct LFO : modules::XTModule
         return false;
     }
 
+    /*
+     * Each voice's LFO reads its own copy of the scene data. The unmodulated values are
+     * copied from the patch once a block and only pushed to the voices when they change;
+     * the modulated ones (and the phase, when driven directly) are computed for every
+     * voice four lanes at a time and then scattered into the voice slices.
+     */
+    pdata voiceScenedata alignas(16)[MAX_POLY][n_scene_params];
+    pdata sharedScenedata alignas(16)[n_scene_params];
+    float perVoiceValues alignas(16)[n_lfo_params][MAX_POLY];
+    std::array<bool, n_lfo_params> voiceModulated{};
+    bool forceSharedScenedata{true};
+
+    void resolveVoiceScenedata(int nChan, bool direct)
+    {
+        auto &patch = storage->getPatch();
+        int s = patch.scene_start[0];
+        auto *par0 = &(lfostorage->rate);
+
+        for (int p = 0; p < n_lfo_params; ++p)
+        {
+            auto *oap = &par0[paramOffsetByID[p + RATE]];
+            auto pv = oap->valtype == vt_float &&
+                      (modAssist.connectedParameter[p] || (direct && p + RATE == PHASE));
+            if (pv != voiceModulated[p])
+            {
+                voiceModulated[p] = pv;
+                forceSharedScenedata = true;
+            }
+        }
+
+        bool force = forceSharedScenedata;
+        int nc = force ? MAX_POLY : nChan;
+        for (int i = storage_id_start; i < storage_id_end; ++i)
+        {
+            auto v = patch.param_ptr[i]->val.i;
+            if (force || sharedScenedata[i - s].i != v)
+            {
+                sharedScenedata[i - s].i = v;
+                for (int c = 0; c < nc; ++c)
+                    voiceScenedata[c][i - s].i = v;
+            }
+        }
+        forceSharedScenedata = false;
+
+        int polyChans = (nChan - 1) / 4 + 1;
+        for (int p = 0; p < n_lfo_params; ++p)
+        {
+            if (!voiceModulated[p])
+                continue;
+
+            auto *oap = &par0[paramOffsetByID[p + RATE]];
+            auto idx = oap->param_id_in_scene;
+
+            if (direct && p + RATE == PHASE)
+            {
+                // The direct input replaces the phase knob as the base value per voice
+                for (int c = 0; c < nChan; ++c)
+                {
+                    auto pd = inputs[INPUT_PHASE_DIRECT].getVoltage(c) * RACK_TO_SURGE_CV_MUL;
+                    oap->set_value_f01(pd);
+                    perVoiceValues[p][c] = oap->val.f;
+                }
+                oap->val.i = sharedScenedata[idx].i;
+            }
+            else
+            {
+                for (int c = 0; c < nChan; ++c)
+                    perVoiceValues[p][c] = sharedScenedata[idx].f;
+            }
+
+            // Apply the modulation on top of the copied value to preserve temposync
+            auto scale = _mm_set1_ps(oap->val_max.f - oap->val_min.f);
+            for (int c = 0; c < polyChans; ++c)
+            {
+                auto b = _mm_load_ps(&perVoiceValues[p][c * 4]);
+                auto m = _mm_load_ps(&modAssist.modvalues[p][c * 4]);
+                _mm_store_ps(&perVoiceValues[p][c * 4], _mm_add_ps(b, _mm_mul_ps(m, scale)));
+            }
+            for (int c = 0; c < nChan; ++c)
+                voiceScenedata[c][idx].f = perVoiceValues[p][c];
+        }
+    }
+
     int lastStep = BLOCK_SIZE;
     int lastNChan = -1;
     bool firstProcess{true};
@@ -425,6 +510,7 @@ struct LFO : modules::XTModule
         if (nChan != lastNChan)
         {
             firstProcess = true;
+            forceSharedScenedata = true;
             lastNChan = nChan;
             for (int i = nChan; i < MAX_POLY; ++i)
                 lastStep = BLOCK_SIZE;
@@ -543,6 +629,10 @@ struct LFO : modules::XTModule
             }
 
             lfostorage->rate.deactivated = direct;
+            lfostorage->trigmode.val.i =
+                params[RANDOM_PHASE].getValue() > 0.5 ? lm_random : lm_keytrigger;
+            resolveVoiceScenedata(nChan, direct);
+
             bool scaleAmp = params[SCALE_RAW_OUTPUTS].getValue() > 0.5;
             bool anyGateConnected =
                 inputs[INPUT_GATE].isConnected() || inputs[INPUT_GATE_ENVONLY].isConnected();
@@ -565,28 +655,6 @@ struct LFO : modules::XTModule
                 }
                 prevAnyGateInputHigh[c] = anyGateInputHigh[c];
 
-                if (direct)
-                {
-                    auto pd = inputs[INPUT_PHASE_DIRECT].getVoltage(c) * RACK_TO_SURGE_CV_MUL;
-                    lfostorage->start_phase.set_value_f01(pd);
-                }
-                lfostorage->trigmode.val.i =
-                    params[RANDOM_PHASE].getValue() > 0.5 ? lm_random : lm_keytrigger;
-
-                copyScenedataSubset(0, storage_id_start, storage_id_end);
-
-                // Apply the modulation to the copied result to preserve temposync
-                auto *par0 = &(lfostorage->rate);
-                auto &pt = storage->getPatch().scenedata[0];
-                for (int p = RATE; p < RATE + n_lfo_params; ++p)
-                {
-                    auto *oap = &par0[paramOffsetByID[p]];
-                    if (oap->valtype == vt_float)
-                    {
-                        pt[oap->param_id_in_scene].f +=
-                            modAssist.modvalues[p - RATE][c] * (oap->val_max.f - oap->val_min.f);
-                    }
-                }
 
                 surge_lfo[c]->onepoleFactor = onepoleFactor;
 
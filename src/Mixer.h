@@ -23,6 +23,7 @@
 #include "XTModule.h"
 #include "rack.hpp"
 #include <cstring>
+#include <random>
 #include "DebugHelpers.h"
 #include "globals.h"
 #include "DSPUtils.h"
@@ -109,14 +110,19 @@ struct Mixer : modules::XTModule, sst::rackhelpers::module_connector::NeighborCo
     std::array<bool, 3> needed;
     std::array<bool, 3> everConnected;
     float noisegen[MAX_POLY][2][2];
+    std::default_random_engine gen;
+    std::uniform_real_distribution<float> distro;
 
     Mixer() : XTModule()
     {
-        std::lock_guard<std::mutex> ltg(xtSurgeCreateMutex);
-
-        setupSurgeCommon(NUM_PARAMS, false, false);
+        setupSurgeSharedReadOnly(NUM_PARAMS);
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
+        // The storage is shared across modules so don't draw our seed from its generator
+        gen = std::default_random_engine();
+        gen.seed(std::random_device{}());
+        distro = std::uniform_real_distribution<float>(-1.f, 1.f);
+
         // Config
         for (int i = OSC1_LEV; i <= RM2X3_LEV; ++i)
         {
@@ -381,12 +387,12 @@ struct Mixer : modules::XTModule, sst::rackhelpers::module_connector::NeighborCo
                 auto col = std::clamp(modulationAssistant.values[NOISE_COL][p], -1.f, 1.f);
                 oL[p >> 2][p % 4] +=
                     sst::basic_blocks::dsp::correlated_noise_o2mk2_supplied_value(
-                        noisegen[p][0][0], noisegen[p][0][1], col, storage->rand_pm1()) *
+                        noisegen[p][0][0], noisegen[p][0][1], col, distro(gen)) *
                     modules::DecibelParamQuantity::ampToLinear(
                         modulationAssistant.values[NOISE_LEV][p]);
                 oR[p >> 2][p % 4] +=
                     sst::basic_blocks::dsp::correlated_noise_o2mk2_supplied_value(
-                        noisegen[p][1][0], noisegen[p][1][1], col, storage->rand_pm1()) *
+                        noisegen[p][1][0], noisegen[p][1][1], col, distro(gen)) *
                     modules::DecibelParamQuantity::ampToLinear(
                         modulationAssistant.values[NOISE_LEV][p]);
             }
@@ -38,6 +38,18 @@ struct ModMatrixWidget : widgets::XTModuleWidget
         if (toggles[mod])
             toggles[mod]->onToggle(!toggles[mod]->pressedState);
     }
+
+    void appendModuleSpecificMenu(rack::ui::Menu *menu) override
+    {
+        if (!module)
+            return;
+
+        auto m = static_cast<M *>(module);
+        menu->addChild(new rack::ui::MenuSeparator);
+        menu->addChild(rack::createMenuItem(
+            "Audio Rate Modulation Inputs", CHECKMARK(m->audioRateModulation),
+            [m]() { m->audioRateModulation = !m->audioRateModulation; }));
+    }
 };
 
 struct MatrixDisplay : rack::Widget, style::StyleParticipant
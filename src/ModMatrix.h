@@ -60,9 +60,7 @@ struct ModMatrix : modules::XTModule
 
     ModMatrix() : XTModule()
     {
-        std::lock_guard<std::mutex> ltg(xtSurgeCreateMutex);
-
-        setupSurgeCommon(NUM_PARAMS, false, false);
+        setupSurgeSharedReadOnly(NUM_PARAMS);
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
         for (int i = TARGET0; i <= TARGET0 + n_matrix_params; ++i)
@@ -89,6 +87,12 @@ struct ModMatrix : modules::XTModule
             configOutput(OUTPUT_0 + i, name);
         }
 
+        /*
+         * The depth knobs are read every slowUpdate samples and ramped. By default the inputs
+         * are sampled at that rate and ramped too; audioRateModulation passes them through
+         * every sample for audio rate mixing.
+         */
+        offersAudioRateModulation = true;
         modulationAssistant.initialize(this);
     }
     std::string getName() override { return "ModMatrix"; }
@@ -133,6 +137,10 @@ struct ModMatrix : modules::XTModule
         if (blockPos == slowUpdate)
         {
             modulationAssistant.setupMatrix(this);
+            bool ar = audioRateModulation;
+            for (int i = 0; i < n_mod_inputs; ++i)
+                modulationAssistant.audioRate[i] = ar;
+            modulationAssistant.updateRampTargets(this, slowUpdate);
             blockPos = 0;
 
             auto npd = 1;
@@ -150,7 +158,7 @@ struct ModMatrix : modules::XTModule
                 outputs[i].setChannels(polyDepth);
         }
 
-        modulationAssistant.updateValues(this);
+        modulationAssistant.stepRamp(this);
 
         for (int p = 0; p < polyDepthBy4; ++p)
         {
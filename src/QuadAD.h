@@ -29,6 +29,7 @@
 #include "FxPresetAndClipboardManager.h"
 
 #include "LayoutEngine.h"
+#include "EnvelopeBank.h"
 
 #include "sst/basic-blocks/modulators/ADAREnvelope.h"
 
@@ -109,21 +110,18 @@ struct QuadAD : modules::XTModule
     };
 
     typedef basic_blocks::modulators::ADAREnvelope<SurgeStorage, BLOCK_SIZE> envelope_t;
-    std::array<std::array<std::unique_ptr<envelope_t>, MAX_POLY>, n_ads> processors;
+    std::array<modules::EnvelopeBank<envelope_t>, n_ads> processors;
 
     QuadAD() : XTModule()
     {
-        {
-            std::lock_guard<std::mutex> lgxt(xtSurgeCreateMutex);
-            setupSurge();
-        }
+        setupSurge();
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
         for (int i = 0; i < n_ads; ++i)
         {
+            processors[i].setup(storage.get());
             for (int p = 0; p < MAX_POLY; ++p)
             {
-                processors[i][p] = std::make_unique<envelope_t>(storage.get());
                 accumulatedOutputs[i][p] = 0.f;
                 gated[i][p] = false;
                 eocFromAway[i][p] = 0;
@@ -185,7 +183,7 @@ struct QuadAD : modules::XTModule
         snapCalculatedNames();
     }
 
-    void setupSurge() { setupSurgeCommon(NUM_PARAMS, false, false); }
+    void setupSurge() { setupSurgeSharedReadOnly(NUM_PARAMS); }
 
     Parameter *surgeDisplayParameterForParamId(int paramId) override
     {
@@ -228,7 +226,8 @@ struct QuadAD : modules::XTModule
     int processCount{BLOCK_SIZE};
     rack::dsp::SchmittTrigger inputTriggers[n_ads][MAX_POLY], linkTriggers[n_ads][MAX_POLY];
     bool gated[n_ads][MAX_POLY];
-    float accumulatedOutputs[n_ads][MAX_POLY];
+    float accumulatedOutputs alignas(16)[n_ads][MAX_POLY];
+    float envOut alignas(16)[MAX_POLY]{};
 
     bool isEnvLinked[n_ads];
     int adPoly[n_ads];
@@ -411,14 +410,20 @@ struct QuadAD : modules::XTModule
                     processors[i][c]->processScaledAD(modAssist.values[ATTACK_0 + i][c],
                                                       modAssist.values[DECAY_0 + i][c], as, ds,
                                                       gated[i][c]);
+                    envOut[c] = processors[i][c]->output;
+                }
 
-                    auto ov = processors[i][c]->output * 10;
+                // Scale, stack on the linked neighbour and write four voices at a time
+                const auto ten = _mm_set1_ps(10.f);
+                auto *ov = outputs[OUTPUT_0 + i].getVoltages();
+                for (int c = 0; c < ch; c += 4)
+                {
+                    auto v = _mm_mul_ps(_mm_load_ps(&envOut[c]), ten);
                     if (isEnvLinked[i])
-                        ov += accumulatedOutputs[envLinkIdx][c];
-
-                    outputs[OUTPUT_0 + i].setVoltage(ov, c);
-                    accumulatedOutputs[i][c] = ov;
+                        v = _mm_add_ps(v, _mm_load_ps(&accumulatedOutputs[envLinkIdx][c]));
+                    _mm_storeu_ps(ov + c, v);
                 }
+                memcpy(accumulatedOutputs[i], ov, ch * sizeof(float));
             }
             else
             {
@@ -23,6 +23,8 @@
 #include "XTModule.h"
 #include "rack.hpp"
 #include <cstring>
+#include <memory>
+#include <mutex>
 
 #include "DebugHelpers.h"
 #include "FxPresetAndClipboardManager.h"
@@ -34,6 +36,242 @@
 
 namespace sst::surgext_rack::quadlfo
 {
+/*
+ * The QuadLFO's LFOs as one structure of arrays, a row per LFO and a lane per channel, for
+ * the shapes which draw no random numbers: sine, both ramps, triangle and pulse. A row
+ * steps its phase and evaluates its shape four channels to an SSE op, following
+ * SimpleLFO's arithmetic for those shapes: advance and wrap the phase, shape it, bend it by
+ * the deform, scale by the amplitude and ramp from the last target over the block. Sine
+ * takes std::sin per lane as SimpleLFO does. The per voice attack, freeze, phase offset and
+ * amplitude calls stay scalar since they happen at most once a block.
+ *
+ * The first QuadLFO runs a self test against SimpleLFO and if any sample differs no row
+ * uses the bank. A row whose shape is random stays on its SimpleLFOs, and the voice state
+ * moves across whenever a row changes sides.
+ */
+template <typename lfo_t, int nRows> struct LFOBank
+{
+    float phase alignas(16)[nRows][MAX_POLY]{};
+    float lastTarget alignas(16)[nRows][MAX_POLY]{};
+    float phaseOffset alignas(16)[nRows][MAX_POLY]{};
+    float amplitude alignas(16)[nRows][MAX_POLY]{};
+    float frate alignas(16)[nRows][MAX_POLY]{};
+    float deform alignas(16)[nRows][MAX_POLY]{};
+    uint32_t holdMask alignas(16)[nRows][MAX_POLY]{};
+    // sample major so each output sample is a vector store per four channels
+    float output alignas(16)[nRows][BLOCK_SIZE][MAX_POLY]{};
+    std::array<bool, nRows> active{};
+
+    static_assert(MAX_POLY % 4 == 0, "Rows are processed four lanes at a time");
+
+    struct SelfTest
+    {
+        std::atomic<bool> passed{false};
+    };
+    static SelfTest &selfTest()
+    {
+        static SelfTest st;
+        return st;
+    }
+
+    static bool handlesShape(int shape)
+    {
+        return shape == lfo_t::SINE || shape == lfo_t::RAMP || shape == lfo_t::DOWN_RAMP ||
+               shape == lfo_t::TRI || shape == lfo_t::PULSE;
+    }
+
+    void fromScalar(int i, int c, const lfo_t &l)
+    {
+        phase[i][c] = l.phase;
+        lastTarget[i][c] = l.lastTarget;
+        phaseOffset[i][c] = l.phaseOffset;
+        amplitude[i][c] = l.amplitude;
+    }
+
+    void toScalar(int i, int c, lfo_t &l) const
+    {
+        l.phase = phase[i][c];
+        l.lastTarget = lastTarget[i][c];
+        l.phaseOffset = phaseOffset[i][c];
+        l.amplitude = amplitude[i][c];
+    }
+
+    void attack(int i, int c) { phase[i][c] = phaseOffset[i][c]; }
+
+    void applyPhaseOffset(int i, int c, float dPhase)
+    {
+        if (dPhase != phaseOffset[i][c])
+        {
+            auto dp = dPhase - phaseOffset[i][c];
+            if (dp < 0)
+                dp += 1;
+            auto &ph = phase[i][c];
+            ph += dp;
+            if (ph > 1)
+                ph -= 1;
+            phaseOffset[i][c] = dPhase;
+        }
+    }
+
+    void setAmplitude(int i, int c, float a) { amplitude[i][c] = a; }
+
+    // Holds the voice at its last target for this block
+    void freeze(int i, int c) { holdMask[i][c] = 0xFFFFFFFF; }
+
+    void prepare(int i, int c, SurgeStorage *s, float r, float d, bool reverse = false)
+    {
+        auto fr = s->envelope_rate_linear_nowrap(-r);
+        frate[i][c] = reverse ? -fr : fr;
+        deform[i][c] = d;
+        holdMask[i][c] = 0;
+    }
+
+    static inline __m128 select(__m128 m, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+    }
+
+    // SimpleLFO's deform bend
+    static inline __m128 bend(__m128 x, __m128 d)
+    {
+        auto a = _mm_mul_ps(_mm_set1_ps(0.5f),
+                            _mm_min_ps(_mm_max_ps(d, _mm_set1_ps(-3.f)), _mm_set1_ps(3.f)));
+        for (int k = 0; k < 2; ++k)
+            x = _mm_add_ps(_mm_sub_ps(x, _mm_mul_ps(_mm_mul_ps(a, x), x)), a);
+        return x;
+    }
+
+    void process(int i, int nChan, int shape)
+    {
+        const auto one = _mm_set1_ps(1.f), zero = _mm_setzero_ps(), two = _mm_set1_ps(2.f);
+        const auto bsInv = _mm_set1_ps(1.f / BLOCK_SIZE);
+
+        // lanes past the channel count are held so their state doesn't move
+        for (int c = nChan; c < ((nChan + 3) & ~3); ++c)
+            holdMask[i][c] = 0xFFFFFFFF;
+
+        for (int c = 0; c < nChan; c += 4)
+        {
+            auto hold = _mm_castsi128_ps(_mm_load_si128((const __m128i *)&holdMask[i][c]));
+            auto ph0 = _mm_load_ps(&phase[i][c]);
+            auto last = _mm_load_ps(&lastTarget[i][c]);
+            auto d = _mm_load_ps(&deform[i][c]);
+
+            auto ph = _mm_add_ps(ph0, _mm_load_ps(&frate[i][c]));
+            ph = select(_mm_cmpgt_ps(ph, one), _mm_sub_ps(ph, one),
+                        select(_mm_cmplt_ps(ph, zero), _mm_add_ps(ph, one), ph));
+            ph = select(hold, ph0, ph);
+
+            __m128 x;
+            switch (shape)
+            {
+            case lfo_t::SINE:
+            {
+                float p alignas(16)[4], sv alignas(16)[4];
+                _mm_store_ps(p, ph);
+                for (int k = 0; k < 4; ++k)
+                    sv[k] = std::sin(2.0 * M_PI * p[k]);
+                x = bend(_mm_load_ps(sv), d);
+            }
+            break;
+            case lfo_t::RAMP:
+                x = bend(_mm_sub_ps(_mm_mul_ps(two, ph), one), d);
+                break;
+            case lfo_t::DOWN_RAMP:
+                x = bend(_mm_sub_ps(_mm_mul_ps(two, _mm_sub_ps(one, ph)), one), d);
+                break;
+            case lfo_t::TRI:
+            {
+                auto tph = _mm_add_ps(ph, _mm_set1_ps(0.25f));
+                tph = select(_mm_cmpgt_ps(tph, one), _mm_sub_ps(tph, one), tph);
+                auto fold =
+                    select(_mm_cmpgt_ps(tph, _mm_set1_ps(0.5f)), _mm_sub_ps(one, tph), tph);
+                x = bend(_mm_add_ps(_mm_set1_ps(-1.f), _mm_mul_ps(_mm_set1_ps(4.f), fold)), d);
+            }
+            break;
+            default:
+            {
+                auto width = _mm_mul_ps(_mm_add_ps(d, one), _mm_set1_ps(0.5f));
+                x = select(_mm_cmplt_ps(ph, width), one, _mm_set1_ps(-1.f));
+            }
+            break;
+            }
+
+            auto target = select(hold, last, _mm_mul_ps(x, _mm_load_ps(&amplitude[i][c])));
+            auto dO = _mm_mul_ps(_mm_sub_ps(target, last), bsInv);
+            for (int s = 0; s < BLOCK_SIZE; ++s)
+                _mm_store_ps(&output[i][s][c],
+                             _mm_add_ps(last, _mm_mul_ps(dO, _mm_set1_ps((float)s))));
+
+            _mm_store_ps(&phase[i][c], ph);
+            _mm_store_ps(&lastTarget[i][c], target);
+        }
+    }
+
+    /*
+     * Runs a SimpleLFO and one bank lane side by side for every shape the bank handles,
+     * over a spread of rates and deforms, through a phase offset, amplitude changes,
+     * reverse, freeze and a retrigger, and only lets the bank run if every sample of every
+     * block matches exactly.
+     */
+    static void runSelfTest(SurgeStorage *storage)
+    {
+        static std::once_flag once;
+        std::call_once(once, [storage]() {
+            auto bank = std::make_unique<LFOBank>();
+            bool pass{true};
+            for (auto shape : {lfo_t::SINE, lfo_t::RAMP, lfo_t::DOWN_RAMP, lfo_t::TRI,
+                               lfo_t::PULSE})
+            {
+                for (auto d : {-1.f, -0.35f, 0.f, 0.6f, 1.f})
+                {
+                    for (auto r : {-4.f, 0.f, 2.5f, 6.f})
+                    {
+                        auto l = std::make_unique<lfo_t>(storage, 1);
+                        bank->fromScalar(0, 0, *l);
+                        for (int b = 0; b < 48 && pass; ++b)
+                        {
+                            if (b == 10 || b == 40)
+                            {
+                                auto po = (b == 10) ? 0.3f : 0.1f;
+                                auto am = (b == 10) ? 0.5f : -0.7f;
+                                l->applyPhaseOffset(po);
+                                l->setAmplitude(am);
+                                bank->applyPhaseOffset(0, 0, po);
+                                bank->setAmplitude(0, 0, am);
+                            }
+                            if (b == 36)
+                            {
+                                l->attack(shape);
+                                bank->attack(0, 0);
+                            }
+                            if (b >= 30 && b < 33)
+                            {
+                                l->freeze();
+                                bank->freeze(0, 0);
+                            }
+                            else
+                            {
+                                bool rev = (b >= 20 && b < 25);
+                                l->process_block(r, d, shape, rev);
+                                bank->prepare(0, 0, storage, r, d, rev);
+                            }
+                            bank->process(0, 1, shape);
+                            for (int s = 0; s < BLOCK_SIZE; ++s)
+                                pass = pass && (std::memcmp(&l->outputBlock[s],
+                                                            &bank->output[0][s][0],
+                                                            sizeof(float)) == 0);
+                        }
+                    }
+                }
+            }
+            if (!pass)
+                WARN("QuadLFO bank differs from SimpleLFO; using SimpleLFO for every shape");
+            selfTest().passed = pass;
+        });
+    }
+};
+
 struct QuadLFO : modules::XTModule
 {
     static constexpr int n_mod_params{8};
@@ -628,10 +866,7 @@ struct QuadLFO : modules::XTModule
 
     QuadLFO() : XTModule()
     {
-        {
-            std::lock_guard<std::mutex> lgxt(xtSurgeCreateMutex);
-            setupSurge();
-        }
+        setupSurge();
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
         float defaultRate0 = RateQuantity::independentRateScaleInv(0.f);
@@ -673,11 +908,91 @@ struct QuadLFO : modules::XTModule
             }
         }
 
+        LFOBank<lfoSource_t, n_lfos>::runSelfTest(storage.get());
+
         resetInteractionType(INDEPENDENT);
         snapCalculatedNames();
     }
 
     std::array<std::array<std::unique_ptr<lfoSource_t>, MAX_POLY>, n_lfos> processors;
+    LFOBank<lfoSource_t, n_lfos> bank;
+
+    // Moves each row onto or off the bank as its shape allows, carrying the voice state
+    void selectLFORows()
+    {
+        auto ok = LFOBank<lfoSource_t, n_lfos>::selfTest().passed.load();
+        for (int i = 0; i < n_lfos; ++i)
+        {
+            auto shape = (int)std::round(params[SHAPE_0 + i].getValue());
+            auto want = ok && LFOBank<lfoSource_t, n_lfos>::handlesShape(shape);
+            if (want == bank.active[i])
+                continue;
+            for (int c = 0; c < MAX_POLY; ++c)
+            {
+                if (want)
+                    bank.fromScalar(i, c, *processors[i][c]);
+                else
+                    bank.toScalar(i, c, *processors[i][c]);
+            }
+            bank.active[i] = want;
+        }
+    }
+
+    void lfoAttack(int i, int c, int shape)
+    {
+        if (bank.active[i])
+            bank.attack(i, c);
+        else
+            processors[i][c]->attack(shape);
+    }
+
+    void lfoFreeze(int i, int c)
+    {
+        if (bank.active[i])
+            bank.freeze(i, c);
+        else
+            processors[i][c]->freeze();
+    }
+
+    void lfoApplyPhaseOffset(int i, int c, float dph)
+    {
+        if (bank.active[i])
+            bank.applyPhaseOffset(i, c, dph);
+        else
+            processors[i][c]->applyPhaseOffset(dph);
+    }
+
+    void lfoSetAmplitude(int i, int c, float a)
+    {
+        if (bank.active[i])
+            bank.setAmplitude(i, c, a);
+        else
+            processors[i][c]->setAmplitude(a);
+    }
+
+    // The bank rows only gather their rates here and run together in finishLFOBlock
+    void lfoProcess(int i, int c, float r, float d, int shape, bool reverse = false)
+    {
+        if (bank.active[i])
+            bank.prepare(i, c, storage.get(), r, d, reverse);
+        else
+            processors[i][c]->process_block(r, d, shape, reverse);
+    }
+
+    void finishLFOBlock()
+    {
+        for (int i = 0; i < n_lfos; ++i)
+        {
+            if (bank.active[i])
+            {
+                bank.process(i, chanByLFO[i], (int)std::round(params[SHAPE_0 + i].getValue()));
+                continue;
+            }
+            for (int c = 0; c < chanByLFO[i]; ++c)
+                for (int s = 0; s < BLOCK_SIZE; ++s)
+                    bank.output[i][s][c] = processors[i][c]->outputBlock[s];
+        }
+    }
     void setupSurge() { setupSurgeCommon(NUM_PARAMS, false, false); }
 
     int polyChannelCount() { return nChan; }
@@ -858,6 +1173,7 @@ struct QuadLFO : modules::XTModule
 
             modAssist.setupMatrix(this);
             modAssist.updateValues(this);
+            selectLFORows();
 
             switch (ip)
             {
@@ -879,16 +1195,18 @@ struct QuadLFO : modules::XTModule
             default:
                 break;
             }
+            finishLFOBlock();
         }
 
+        const auto mul = _mm_set1_ps(SURGE_TO_RACK_OSC_MUL);
         for (int i = 0; i < n_lfos; ++i)
         {
-            for (int c = 0; c < chanByLFO[i]; ++c)
+            auto *ov = outputs[OUTPUT_0 + i].getVoltages();
+            auto off = _mm_set1_ps(uniOffset[i]);
+            for (int c = 0; c < chanByLFO[i]; c += 4)
             {
-                outputs[OUTPUT_0 + i].setVoltage(
-                    (processors[i][c]->outputBlock[processCount] + uniOffset[i]) *
-                        SURGE_TO_RACK_OSC_MUL,
-                    c);
+                auto v = _mm_load_ps(&bank.output[i][processCount][c]);
+                _mm_storeu_ps(ov + c, _mm_mul_ps(_mm_add_ps(v, off), mul));
             }
         }
         processCount++;
@@ -907,9 +1225,9 @@ struct QuadLFO : modules::XTModule
                 if (ic &&
                     triggers[i][c].process(inputs[TRIGGER_0 + i].getVoltage(c * (!monoTrigger))))
                 {
-                    processors[i][c]->attack(shape);
+                    lfoAttack(i, c, shape);
                 }
-                processors[i][c]->process_block(r, modAssist.values[DEFORM_0 + i][c], shape);
+                lfoProcess(i, c, r, modAssist.values[DEFORM_0 + i][c], shape);
             }
         }
     }
@@ -944,7 +1262,7 @@ struct QuadLFO : modules::XTModule
 
                 if (frozen) [[unlikely]]
                 {
-                    processors[i][c]->freeze();
+                    lfoFreeze(i, c);
                 }
                 else
                 {
@@ -960,14 +1278,13 @@ struct QuadLFO : modules::XTModule
                     }
                     if (retrig[c])
                     {
-                        processors[i][c]->attack(shape);
+                        lfoAttack(i, c, shape);
                     }
 
                     bool reverse =
                         rc && (inputs[TRIGGER_0 + REVERSE_TRIGGER].getVoltage(c * (!monoRev)) > 2);
 
-                    processors[i][c]->process_block(r, modAssist.values[DEFORM_0 + i][c], shape,
-                                                    reverse);
+                    lfoProcess(i, c, r, modAssist.values[DEFORM_0 + i][c], shape, reverse);
                 }
             }
         }
@@ -976,7 +1293,7 @@ struct QuadLFO : modules::XTModule
     static float QuadPhaseRelOp(QuadLFO *that, float r, int i, int c)
     {
         auto dph = RateQuantity::phaseRateScale(that->modAssist.values[RATE_0 + i][c]);
-        that->processors[i][c]->applyPhaseOffset(dph);
+        that->lfoApplyPhaseOffset(i, c, dph);
         return r;
     }
     void processQuadPhaseLFOs() { processQuadRelative<QuadPhaseRelOp>(); }
@@ -995,8 +1312,8 @@ struct QuadLFO : modules::XTModule
     static float QuadratureRelOp(QuadLFO *that, float r, int i, int c)
     {
         auto dph = that->modAssist.values[RATE_0 + i][c];
-        that->processors[i][c]->setAmplitude(dph);
-        that->processors[i][c]->applyPhaseOffset(0.25 * i);
+        that->lfoSetAmplitude(i, c, dph);
+        that->lfoApplyPhaseOffset(i, c, 0.25 * i);
         return r;
     }
     void processQuadratureLFOs() { processQuadRelative<QuadratureRelOp>(); }
@@ -1136,7 +1453,7 @@ struct QuadLFO : modules::XTModule
 
                 if (frozen) [[unlikely]]
                 {
-                    processors[i][c]->freeze();
+                    lfoFreeze(i, c);
                 }
                 else
                 {
@@ -1150,12 +1467,12 @@ struct QuadLFO : modules::XTModule
 
                     if (retrig[c])
                     {
-                        processors[i][c]->attack(shape);
+                        lfoAttack(i, c, shape);
                     }
-                    processors[i][c]->applyPhaseOffset(p0);
-                    processors[i][c]->setAmplitude(a0);
+                    lfoApplyPhaseOffset(i, c, p0);
+                    lfoSetAmplitude(i, c, a0);
 
-                    processors[i][c]->process_block(r0, d0, shape, reverse);
+                    lfoProcess(i, c, r0, d0, shape, reverse);
                 }
             }
         }
@@ -1168,6 +1485,7 @@ struct QuadLFO : modules::XTModule
             for (int c = 0; c < MAX_POLY; ++c)
             {
                 processors[i][c]->setAmplitude(1.0);
+                bank.setAmplitude(i, c, 1.0);
             }
             paramQuantities[RATE_0 + i]->defaultValue = RateQuantity::independentRateScaleInv(0);
             if (tempoSynced && ip != INDEPENDENT)
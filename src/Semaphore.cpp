@@ -0,0 +1,67 @@
+/*
+ * SurgeXT for VCV Rack - a Surge Synth Team product
+ *
+ * A set of modules expressing Surge XT into the VCV Rack Module Ecosystem
+ *
+ * Copyright 2019 - 2024, Various authors, as described in the github
+ * transaction log.
+ *
+ * Surge XT for VCV Rack is released under the GNU General Public License
+ * 3.0 or later (GPL-3.0-or-later). A copy of the license is in this
+ * repository in the file "LICENSE" or at:
+ *
+ * or at https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * All source for Surge XT for VCV Rack is available at
+ * https://github.com/surge-synthesizer/surge-rack/
+ */
+
+#include "Semaphore.h"
+
+#if WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <climits>
+#elif MAC
+#include <dispatch/dispatch.h>
+#else
+#include <cerrno>
+#include <semaphore.h>
+#endif
+
+namespace sst::surgext_rack::modules
+{
+#if WINDOWS
+Semaphore::Semaphore() { impl = CreateSemaphore(nullptr, 0, LONG_MAX, nullptr); }
+Semaphore::~Semaphore() { CloseHandle((HANDLE)impl); }
+void Semaphore::post() { ReleaseSemaphore((HANDLE)impl, 1, nullptr); }
+void Semaphore::wait() { WaitForSingleObject((HANDLE)impl, INFINITE); }
+#elif MAC
+Semaphore::Semaphore() { impl = dispatch_semaphore_create(0); }
+Semaphore::~Semaphore() { dispatch_release((dispatch_semaphore_t)impl); }
+void Semaphore::post() { dispatch_semaphore_signal((dispatch_semaphore_t)impl); }
+void Semaphore::wait()
+{
+    dispatch_semaphore_wait((dispatch_semaphore_t)impl, DISPATCH_TIME_FOREVER);
+}
+#else
+Semaphore::Semaphore()
+{
+    auto *s = new sem_t;
+    sem_init(s, 0, 0);
+    impl = s;
+}
+Semaphore::~Semaphore()
+{
+    sem_destroy((sem_t *)impl);
+    delete (sem_t *)impl;
+}
+void Semaphore::post() { sem_post((sem_t *)impl); }
+void Semaphore::wait()
+{
+    while (sem_wait((sem_t *)impl) != 0 && errno == EINTR)
+    {
+    }
+}
+#endif
+} // namespace sst::surgext_rack::modules
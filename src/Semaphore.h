@@ -0,0 +1,41 @@
+/*
+ * SurgeXT for VCV Rack - a Surge Synth Team product
+ *
+ * A set of modules expressing Surge XT into the VCV Rack Module Ecosystem
+ *
+ * Copyright 2019 - 2024, Various authors, as described in the github
+ * transaction log.
+ *
+ * Surge XT for VCV Rack is released under the GNU General Public License
+ * 3.0 or later (GPL-3.0-or-later). A copy of the license is in this
+ * repository in the file "LICENSE" or at:
+ *
+ * or at https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * All source for Surge XT for VCV Rack is available at
+ * https://github.com/surge-synthesizer/surge-rack/
+ */
+
+#ifndef SURGE_XT_RACK_SRC_SEMAPHORE_H
+#define SURGE_XT_RACK_SRC_SEMAPHORE_H
+
+namespace sst::surgext_rack::modules
+{
+/*
+ * A counting semaphore on the platform primitive, whose post takes no user space lock,
+ * so the audio thread can use it to wake a helper thread.
+ */
+struct Semaphore
+{
+    Semaphore();
+    ~Semaphore();
+    Semaphore(const Semaphore &) = delete;
+    Semaphore &operator=(const Semaphore &) = delete;
+    void post();
+    void wait();
+
+  private:
+    void *impl{nullptr};
+};
+} // namespace sst::surgext_rack::modules
+#endif
@@ -0,0 +1,87 @@
+/*
+ * SurgeXT for VCV Rack - a Surge Synth Team product
+ *
+ * A set of modules expressing Surge XT into the VCV Rack Module Ecosystem
+ *
+ * Copyright 2019 - 2024, Various authors, as described in the github
+ * transaction log.
+ *
+ * Surge XT for VCV Rack is released under the GNU General Public License
+ * 3.0 or later (GPL-3.0-or-later). A copy of the license is in this
+ * repository in the file "LICENSE" or at:
+ *
+ * or at https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * All source for Surge XT for VCV Rack is available at
+ * https://github.com/surge-synthesizer/surge-rack/
+ */
+
+#ifndef SURGE_XT_RACK_SRC_STEREOSINCDELAYLINE_H
+#define SURGE_XT_RACK_SRC_STEREOSINCDELAYLINE_H
+
+#include <cstring>
+#include "globals.h"
+
+namespace sst::surgext_rack::delay
+{
+/*
+ * A stereo version of surge's SSESincDelayLine for the case where both sides are read
+ * at the same delay. The sides are stored interleaved so one pass over the 12 tap sinc
+ * window computes left and right together, with the coefficients duplicated into
+ * adjacent lanes. Uses the same sinc table layout and read position as the mono line.
+ */
+template <size_t COMB_SIZE> struct StereoSincDelayLine
+{
+    static_assert((COMB_SIZE & (COMB_SIZE - 1)) == 0, "Comb size must be a power of two");
+    static_assert(FIRipol_N % 4 == 0, "Sinc window must be a multiple of 4");
+
+    float buffer alignas(16)[2 * (COMB_SIZE + FIRipol_N)];
+    int wp{0};
+    const float *sinctable{nullptr};
+
+    StereoSincDelayLine(const float *st) : sinctable(st) { clear(); }
+
+    inline void write(float l, float r)
+    {
+        buffer[2 * wp] = l;
+        buffer[2 * wp + 1] = r;
+        if (wp < FIRipol_N)
+        {
+            buffer[2 * (wp + COMB_SIZE)] = l;
+            buffer[2 * (wp + COMB_SIZE) + 1] = r;
+        }
+        wp = (wp + 1) & (COMB_SIZE - 1);
+    }
+
+    inline void read(float delay, float &l, float &r) const
+    {
+        auto iDelay = (int)delay;
+        auto fracDelay = delay - iDelay;
+        auto sincTableOffset = (int)((1 - fracDelay) * FIRipol_M) * FIRipol_N * 2;
+        int readPtr = (wp - iDelay - (FIRipol_N >> 1)) & (COMB_SIZE - 1);
+
+        const float *b = &buffer[2 * readPtr];
+        const float *s = &sinctable[sincTableOffset];
+        auto acc = _mm_setzero_ps();
+        for (int k = 0; k < FIRipol_N; k += 4)
+        {
+            auto c = _mm_loadu_ps(s + k);
+            // c0 c0 c1 c1 and c2 c2 c3 c3 against L0 R0 L1 R1 and L2 R2 L3 R3
+            auto c01 = _mm_unpacklo_ps(c, c);
+            auto c23 = _mm_unpackhi_ps(c, c);
+            acc = _mm_add_ps(acc, _mm_mul_ps(c01, _mm_loadu_ps(b + 2 * k)));
+            acc = _mm_add_ps(acc, _mm_mul_ps(c23, _mm_loadu_ps(b + 2 * k + 4)));
+        }
+        auto sum = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+        l = _mm_cvtss_f32(sum);
+        r = _mm_cvtss_f32(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+    }
+
+    void clear()
+    {
+        memset((void *)buffer, 0, sizeof(buffer));
+        wp = 0;
+    }
+};
+} // namespace sst::surgext_rack::delay
+#endif
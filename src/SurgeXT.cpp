@@ -18,6 +18,7 @@
 
 #include "SurgeXT.h"
 #include "XTStyle.h"
+#include "XTModule.h"
 
 namespace logger = rack::logger;
 rack::Plugin *pluginInstance;
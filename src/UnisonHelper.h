@@ -135,10 +135,7 @@ struct UnisonHelper : modules::XTModule, sst::rackhelpers::module_connector::Nei
     };
     UnisonHelper() : XTModule()
     {
-        {
-            std::lock_guard<std::mutex> lgxt(xtSurgeCreateMutex);
-            setupSurge();
-        }
+        setupSurge();
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
 
         configParam<DetuneParamQuantity>(DETUNE, 0, 1, 0.1, "Detune");
@@ -197,7 +194,7 @@ struct UnisonHelper : modules::XTModule, sst::rackhelpers::module_connector::Nei
 
     void setupSurge()
     {
-        setupSurgeCommon(NUM_PARAMS, false, false);
+        setupSurgeSharedReadOnly(NUM_PARAMS);
         for (auto &cf : characterFilter)
         {
             cf.storage = storage.get();
@@ -69,6 +69,23 @@ struct VCFWidget : widgets::XTModuleWidget
             menu->addChild(rack::createSubmenuItem(
                 "Curve Poly Channel", "",
                 [this, m = static_cast<VCF *>(module)](auto *x) { displayChannelMenu(x, m); }));
+
+            auto m = static_cast<VCF *>(module);
+            menu->addChild(rack::createSubmenuItem("Cutoff Modulation Rate", "", [m](auto *x) {
+                int cur = m->coefficientInterval;
+                const auto &choices = VCF::coefficientIntervalChoices;
+                for (size_t i = 0; i < choices.size(); ++i)
+                {
+                    auto ci = choices[i];
+                    if (ci > BLOCK_SIZE || BLOCK_SIZE % ci != 0 || (i > 0 && ci == BLOCK_SIZE))
+                        continue;
+                    auto lab = (ci == BLOCK_SIZE) ? std::string("Every Block")
+                               : (ci == 1)        ? std::string("Every Sample")
+                                                  : fmt::format("Every {} Samples", ci);
+                    x->addChild(rack::createMenuItem(lab, CHECKMARK(ci == cur),
+                                                     [m, ci]() { m->coefficientInterval = ci; }));
+                }
+            }));
         }
     }
 };
@@ -100,9 +100,8 @@ struct VCF : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
 
     VCF() : XTModule()
     {
-        std::lock_guard<std::mutex> lgxt(xtSurgeCreateMutex);
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
-        setupSurgeCommon(NUM_PARAMS, false, false);
+        setupSurgeSharedReadOnly(NUM_PARAMS);
 
         // FIXME attach formatters here
         configParam<modules::VOctParamQuantity<60>>(FREQUENCY, -4, 6, 0, "Frequency");
@@ -188,21 +187,37 @@ struct VCF : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
                                 sst::filters::utilities::SincTable::FIRipol_N];
     std::atomic<int> displayPolyChannel{0};
 
+    /*
+     * The coefficient makers already ramp each coefficient linearly from its current
+     * value to the new target across the update interval. By default that interval is
+     * a block; shortening it re-evaluates the modulation and the target coefficients
+     * every few samples so fast cutoff modulation tracks more closely, at the cost of
+     * more MakeCoeffs calls for this module only.
+     */
+    static constexpr std::array<int, 4> coefficientIntervalChoices{BLOCK_SIZE, 4, 2, 1};
+    std::atomic<int> coefficientInterval{BLOCK_SIZE};
+    int activeCoefficientInterval{BLOCK_SIZE};
+
+    void setupCoefficientMakers()
+    {
+        for (auto i = 0; i < MAX_POLY; ++i)
+            coefMaker[i].setSampleRateAndBlockSize(APP->engine->getSampleRate(),
+                                                   activeCoefficientInterval);
+    }
+
     void setupSurge()
     {
         processPosition = BLOCK_SIZE;
 
         restackSIMD();
-        for (auto i = 0; i < MAX_POLY; ++i)
-            coefMaker[i].setSampleRateAndBlockSize(APP->engine->getSampleRate(), BLOCK_SIZE);
+        setupCoefficientMakers();
         resetFilterRegisters();
     }
 
     void moduleSpecificSampleRateChange() override
     {
         restackSIMD();
-        for (auto i = 0; i < MAX_POLY; ++i)
-            coefMaker[i].setSampleRateAndBlockSize(APP->engine->getSampleRate(), BLOCK_SIZE);
+        setupCoefficientMakers();
         resetFilterRegisters();
     }
 
@@ -234,6 +249,7 @@ struct VCF : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
     {
         auto vcf = json_object();
         json_object_set_new(vcf, "displayPolyChannel", json_integer(displayPolyChannel));
+        json_object_set_new(vcf, "coefficientInterval", json_integer(coefficientInterval));
         return vcf;
     }
 
@@ -242,6 +258,11 @@ struct VCF : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
         auto pc = rackhelpers::json::jsonSafeGet<int>(modJ, "displayPolyChannel");
         if (pc.has_value())
             displayPolyChannel = *pc;
+
+        auto ci = rackhelpers::json::jsonSafeGet<int>(modJ, "coefficientInterval");
+        coefficientInterval = BLOCK_SIZE;
+        if (ci.has_value() && *ci >= 1 && *ci <= BLOCK_SIZE && BLOCK_SIZE % *ci == 0)
+            coefficientInterval = *ci;
     }
 
     int processPosition;
@@ -250,6 +271,21 @@ struct VCF : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
     int qfuIndexForVoice[MAX_POLY << 1][2];  // L-R Voice, {QFU, SIMD Slot}
     int voiceIndexForPolyPos[MAX_POLY << 1]; // only used in stereo mode
 
+    /*
+     * In stereo the Ls are stacked before the Rs, so every SIMD slot whose four lanes
+     * are all channels of one port reads and writes them directly. A slot straddling the
+     * L/R boundary or extending past that port's channel count needs the element-wise
+     * gather. Source is 0 for L, 1 for R and -1 for gather.
+     */
+    enum StereoSlotSource
+    {
+        GATHER_SLOT = -1,
+        LEFT_SLOT = 0,
+        RIGHT_SLOT = 1
+    };
+    int stereoSlotSource[MAX_POLY >> 1];
+    int stereoSlotOffset[MAX_POLY >> 1];
+
     int lastPolyL{-2}, lastPolyR{-2};
     int monoChannelOffset{0};
 
@@ -326,6 +362,20 @@ struct VCF : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
                 voiceIndexForPolyPos[idx] = r;
                 idx++;
             }
+
+            for (int i = 0; i < nSIMDSlots; ++i)
+            {
+                auto p0 = i << 2;
+                auto src = (p0 >= lastPolyL) ? RIGHT_SLOT : LEFT_SLOT;
+                auto off = (src == RIGHT_SLOT) ? p0 - lastPolyL : p0;
+                // all four lanes have to be real channels of that port, so a partial
+                // last slot on either side gathers rather than touching unused channels
+                auto portChannels = (src == RIGHT_SLOT) ? lastPolyR : lastPolyL;
+                if (off + 4 > portChannels)
+                    src = GATHER_SLOT;
+                stereoSlotSource[i] = src;
+                stereoSlotOffset[i] = off;
+            }
         }
 
         // reset all filters
@@ -341,6 +391,37 @@ struct VCF : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
         return in;
     }
 
+    void updateCoefficients(sst::filters::FilterType ftype, sst::filters::FilterSubType fsubtype)
+    {
+        bool calculated[MAX_POLY];
+        std::fill(calculated, calculated + MAX_POLY, false);
+
+        for (int v = 0; v < nVoices; ++v)
+        {
+            int qf = qfuIndexForVoice[v][0];
+            int qp = qfuIndexForVoice[v][1];
+            int pv = voiceIndexForPolyPos[v];
+
+            if (qf < 0 || qf >= nQFUs)
+                continue; // shouldn't happen
+
+            if (!calculated[pv])
+            {
+                for (int f = 0; f < sst::filters::n_cm_coeffs; ++f)
+                {
+                    coefMaker[pv].C[f] = qfus[qf].C[f][qp];
+                }
+                auto fvoct = modulationAssistant.values[FREQUENCY - FREQUENCY][pv];
+                auto fmidi = (fvoct + 5) * 12;
+                coefMaker[pv].MakeCoeffs(fmidi - 69,
+                                         modulationAssistant.values[RESONANCE - FREQUENCY][pv],
+                                         ftype, fsubtype, storage.get(), false);
+                calculated[pv] = true;
+            }
+            coefMaker[pv].updateState(qfus[qf], qp);
+        }
+    }
+
     void process(const typename rack::Module::ProcessArgs &args) override
     {
         auto fpuguard = sst::plugininfra::cpufeatures::FPUStateGuard();
@@ -394,34 +475,15 @@ struct VCF : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
             outputs[OUTPUT_L].setChannels(std::max(1, thisPolyL));
             outputs[OUTPUT_R].setChannels(std::max(1, thisPolyR));
 
-            bool calculated[MAX_POLY];
-            std::fill(calculated, calculated + MAX_POLY, false);
-
-            for (int v = 0; v < nVoices; ++v)
+            int ci = coefficientInterval;
+            if (ci != activeCoefficientInterval)
             {
-                int qf = qfuIndexForVoice[v][0];
-                int qp = qfuIndexForVoice[v][1];
-                int pv = voiceIndexForPolyPos[v];
-
-                if (qf < 0 || qf >= nQFUs)
-                    continue; // shouldn't happen
-
-                if (!calculated[pv])
-                {
-                    for (int f = 0; f < sst::filters::n_cm_coeffs; ++f)
-                    {
-                        coefMaker[pv].C[f] = qfus[qf].C[f][qp];
-                    }
-                    auto fvoct = modulationAssistant.values[FREQUENCY - FREQUENCY][pv];
-                    auto fmidi = (fvoct + 5) * 12;
-                    coefMaker[pv].MakeCoeffs(fmidi - 69,
-                                             modulationAssistant.values[RESONANCE - FREQUENCY][pv],
-                                             ftype, fsubtype, storage.get(), false);
-                    calculated[pv] = true;
-                }
-                coefMaker[pv].updateState(qfus[qf], qp);
+                activeCoefficientInterval = ci;
+                setupCoefficientMakers();
             }
 
+            updateCoefficients(ftype, fsubtype);
+
             for (int i = 0; i < MAX_POLY >> 2; ++i)
             {
                 auto tig = modules::DecibelParamQuantity::ampToLinearSSE(
@@ -438,6 +500,12 @@ struct VCF : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
 
             processPosition = 0;
         }
+        else if (activeCoefficientInterval < BLOCK_SIZE &&
+                 processPosition % activeCoefficientInterval == 0)
+        {
+            modulationAssistant.updateValues(this);
+            updateCoefficients(ftype, fsubtype);
+        }
 
         for (int i = 0; i < MAX_POLY >> 2; i++)
         {
@@ -477,24 +545,8 @@ struct VCF : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
         }
         else if (stereoStack)
         {
-            // We can make this more efficient with smarter SIMD loads later
-            float tmpVal alignas(16)[MAX_POLY << 2];
-            float tmpValOut alignas(16)[MAX_POLY << 2];
-            float *ivl = inputs[INPUT_L].getVoltages();
-            float *ivr = inputs[INPUT_R].getVoltages();
-            float *ovl = outputs[OUTPUT_L].getVoltages();
-            float *ovr = outputs[OUTPUT_R].getVoltages();
-            int idx = 0;
-            for (int l = 0; l < lastPolyL; ++l)
-            {
-                tmpVal[idx] = ivl[l];
-                idx++;
-            }
-            for (int r = 0; r < lastPolyR; ++r)
-            {
-                tmpVal[idx] = ivr[r];
-                idx++;
-            }
+            float *iv[2] = {inputs[INPUT_L].getVoltages(), inputs[INPUT_R].getVoltages()};
+            float *ov[2] = {outputs[OUTPUT_L].getVoltages(), outputs[OUTPUT_R].getVoltages()};
 
             float mvUnload alignas(16)[n_vcf_params][MAX_POLY];
             for (int i = 0; i < MAX_POLY >> 2; i++)
@@ -505,21 +557,35 @@ struct VCF : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
             }
             for (int i = 0; i < nSIMDSlots; ++i)
             {
-                float modsRaw alignas(16)[n_vcf_params][4];
-                __m128 mods[n_vcf_params];
-                int vidx = i << 2;
-                for (int v = 0; v < 4; ++v)
+                auto src = stereoSlotSource[i];
+                __m128 in, mods[n_vcf_params];
+                if (src != GATHER_SLOT)
                 {
-                    auto vc = voiceIndexForPolyPos[v + vidx];
+                    auto off = stereoSlotOffset[i];
+                    in = _mm_loadu_ps(iv[src] + off);
                     for (int p = IN_GAIN; p <= OUT_GAIN; ++p)
+                        mods[p] = _mm_loadu_ps(&mvUnload[p][off]);
+                }
+                else
+                {
+                    float inRaw alignas(16)[4]{0, 0, 0, 0};
+                    float modsRaw alignas(16)[n_vcf_params][4];
+                    int vidx = i << 2;
+                    for (int v = 0; v < 4; ++v)
                     {
-                        modsRaw[p][v] = mvUnload[p][vc];
+                        auto pos = v + vidx;
+                        auto vc = voiceIndexForPolyPos[pos];
+                        if (pos < nVoices)
+                            inRaw[v] = iv[pos >= lastPolyL][vc];
+                        for (int p = IN_GAIN; p <= OUT_GAIN; ++p)
+                            modsRaw[p][v] = mvUnload[p][vc];
                     }
+                    in = _mm_load_ps(inRaw);
+                    for (int p = IN_GAIN; p <= OUT_GAIN; ++p)
+                        mods[p] = _mm_load_ps(modsRaw[p]);
                 }
-                for (int p = IN_GAIN; p <= OUT_GAIN; ++p)
-                    mods[p] = _mm_load_ps(modsRaw[p]);
 
-                auto in = _mm_mul_ps(_mm_loadu_ps(tmpVal + (i << 2)), rackToSurgeOsc);
+                in = _mm_mul_ps(in, rackToSurgeOsc);
                 auto pre = _mm_mul_ps(in, mods[IN_GAIN - FREQUENCY]);
                 auto filt = filterPtr(&qfus[i], pre);
 
@@ -529,19 +595,22 @@ struct VCF : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
                 auto fin = _mm_add_ps(_mm_mul_ps(mods[MIX - FREQUENCY], post), _mm_mul_ps(omm, in));
 
                 fin = _mm_mul_ps(fin, surgeToRackOsc);
-                _mm_storeu_ps(tmpValOut + (i << 2), fin);
-            }
 
-            idx = 0;
-            for (int l = 0; l < lastPolyL; ++l)
-            {
-                ovl[l] = tmpValOut[idx];
-                idx++;
-            }
-            for (int r = 0; r < lastPolyR; ++r)
-            {
-                ovr[r] = tmpValOut[idx];
-                idx++;
+                if (src != GATHER_SLOT)
+                {
+                    _mm_storeu_ps(ov[src] + stereoSlotOffset[i], fin);
+                }
+                else
+                {
+                    float outRaw alignas(16)[4];
+                    _mm_store_ps(outRaw, fin);
+                    int vidx = i << 2;
+                    for (int v = 0; v < 4 && v + vidx < nVoices; ++v)
+                    {
+                        auto pos = v + vidx;
+                        ov[pos >= lastPolyL][voiceIndexForPolyPos[pos]] = outRaw[v];
+                    }
+                }
             }
         }
         else
@@ -36,7 +36,7 @@ template <int oscType> struct WavetableMenuBuilder
     {
         auto msg = typename vco::VCO<oscType>::WavetableMessage();
         msg.index = nt;
-        module->wavetableQueue.push(msg);
+        module->queueWavetableLoad(msg);
     }
 
     static void sendLoadForPath(VCO<oscType> *module, const char *fn, int sz = -1)
@@ -46,7 +46,7 @@ template <int oscType> struct WavetableMenuBuilder
         msg.filename[255] = 0;
         msg.index = -1;
         msg.defaultSize = sz;
-        module->wavetableQueue.push(msg);
+        module->queueWavetableLoad(msg);
     }
 
     static rack::ui::Menu *menuForCategory(rack::ui::Menu *menu, VCO<oscType> *module,
@@ -252,6 +252,26 @@ template <int oscType> struct WavetableMenuBuilder
             }));
         menu->addChild(rack::createMenuItem("Rescan Wavetables", "",
                                             [module]() { module->forceRefreshWT = true; }));
+        menu->addChild(new rack::MenuSeparator);
+        menu->addChild(rack::createMenuItem(
+            "Save Table to Shared Store", CHECKMARK(module->storeWavetablesByDigest), [module]() {
+                module->storeWavetablesByDigest = !module->storeWavetablesByDigest;
+            }));
+        menu->addChild(rack::createMenuItem("Reveal Shared Store Directory", "", []() {
+            auto p = WavetableStore::directory();
+            try
+            {
+                fs::create_directories(p);
+            }
+            catch (const fs::filesystem_error &e)
+            {
+                INFO("Failed to create FS Dir: %s", e.what());
+            }
+            rack::system::openDirectory(p.u8string());
+        }));
+        menu->addChild(rack::createMenuItem(
+            "Cache Built Wavetables on Disk", CHECKMARK(module->useWavetableBuildCache),
+            [module]() { module->useWavetableBuildCache = !module->useWavetableBuildCache; }));
     }
 };
 template <int oscType> struct VCOWidget : public widgets::XTModuleWidget
@@ -387,7 +407,12 @@ template <int oscType> struct VCOWidget : public widgets::XTModuleWidget
             if (vm && vm->forceRefreshWT)
             {
                 vm->forceRefreshWT = false;
-                vm->storage->refresh_wtlist();
+                vm->refreshWavetableCatalogBetweenBuilds();
+            }
+            else if (vm)
+            {
+                // pick up a rescan which another wavetable VCO requested
+                vm->syncWavetableCatalogBetweenBuilds();
             }
         }
         widgets::XTModuleWidget::step();
@@ -507,8 +532,9 @@ struct OSCPlotWidget : public rack::widget::TransparentWidget, style::StyleParti
          * if wavetable changed and draw wavetable bdw->dirty = true
          */
 
-        if (isDirty())
+        if (isDirty() || box.size.x != lastPathSize.x || box.size.y != lastPathSize.y)
         {
+            lastPathSize = box.size;
             recalcPath();
             bdwPlot->dirty = true;
             // Oh dirty can also change the background not just the plot
@@ -518,7 +544,10 @@ struct OSCPlotWidget : public rack::widget::TransparentWidget, style::StyleParti
 
         if constexpr (VCOConfig<oscType>::requiresWavetables())
         {
-            if (wtloadCompare != module->wavetableLoads)
+            // The display borrows a built slot rather than building its own table, and the
+            // loader may move it off the spare too, so the plot reads it under the borrow lock
+            if (module->applyWavetableDisplaySnapshot() ||
+                wtloadCompare != module->wavetableLoads)
             {
                 wtloadCompare = module->wavetableLoads;
                 recalcPath();
@@ -582,6 +611,7 @@ struct OSCPlotWidget : public rack::widget::TransparentWidget, style::StyleParti
     }
 
     bool firstDirty{false};
+    rack::Vec lastPathSize;
     int dirtyCount{0};
     int ppc{-1};
     int sumDeact{-1};
@@ -694,6 +724,10 @@ struct OSCPlotWidget : public rack::widget::TransparentWidget, style::StyleParti
     {
         oscPath.clear();
 
+        std::unique_lock<std::mutex> borrowLock;
+        if (module)
+            borrowLock = std::unique_lock<std::mutex>(module->displayBorrowMutex);
+
         if (VCOConfig<oscType>::requiresWavetables())
         {
             if (module && module->wavetableCount == 0)
@@ -705,7 +739,6 @@ struct OSCPlotWidget : public rack::widget::TransparentWidget, style::StyleParti
 
         if (module && module->draw3DWavetable)
         {
-            auto wtlockguard = std::lock_guard<std::mutex>(module->storage->waveTableDataMutex);
             auto &wt = oscdata->wt;
             auto pos = -1.f;
 
@@ -815,7 +848,6 @@ struct OSCPlotWidget : public rack::widget::TransparentWidget, style::StyleParti
         }
         else
         {
-            auto wtlockguard = std::lock_guard<std::mutex>(module->storage->waveTableDataMutex);
             auto xp = box.size.x;
             auto yp = box.size.y;
 
@@ -969,7 +1001,8 @@ struct OSCPlotWidget : public rack::widget::TransparentWidget, style::StyleParti
         if (!module)
             return;
 
-        auto wtlockguard = std::lock_guard<std::mutex>(module->storage->waveTableDataMutex);
+        std::lock_guard<std::mutex> borrowLock(module->displayBorrowMutex);
+
         auto &wt = oscdata->wt;
         auto pos = -1.f;
 
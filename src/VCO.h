@@ -23,17 +23,31 @@
 #include "dsp/Oscillator.h"
 #include "rack.hpp"
 #include <cstring>
+#include <condition_variable>
 #include <sst/filters/HalfRateFilter.h>
 #include "sst/basic-blocks/mechanics/block-ops.h"
 #include "sst/rackhelpers/neighbor_connectable.h"
 #include "sst/rackhelpers/json.h"
 
 #include "LayoutEngine.h"
+#include "WavetableStore.h"
+#include "WavetableBuildCache.h"
 
 namespace sst::surgext_rack::vco
 {
 template <int oscType> struct VCO;
 
+/*
+ * Oscillator types which can run four voices per SSE op specialise this (see
+ * vcoconfig/Sine.h) with the per voice state, start(), process() and omegaFor(). The VCO
+ * only routes a voice to the batch while VCOConfig::voiceBatchEligible says the settings
+ * are ones the batch reproduces bit for bit, and uses the scalar oscillator otherwise.
+ */
+template <int oscType> struct VCOVoiceBatch
+{
+    static constexpr bool supported{false};
+};
+
 template <int oscType> struct VCOConfig
 {
     typedef sst::surgext_rack::layout::LayoutItem LayoutItem;
@@ -88,6 +102,10 @@ template <int oscType> struct VCOConfig
     }
 
     static void oscillatorReInit(VCO<oscType> *m, Oscillator *o, float pitch0) { o->init(pitch0); }
+
+    // Only consulted when VCOVoiceBatch<oscType>::supported
+    static void voiceBatchSelfTest(VCO<oscType> *m) {}
+    static bool voiceBatchEligible(VCO<oscType> *m, float drift) { return false; }
 };
 
 template <int oscType>
@@ -151,13 +169,15 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
     int spawnOscType{oscType};
     VCO() : XTModule(), halfbandIN(6, true)
     {
-        std::lock_guard<std::mutex> lgxt(xtSurgeCreateMutex);
         auto fpuguard = sst::plugininfra::cpufeatures::FPUStateGuard();
 
         surge_osc.fill(nullptr);
+        fadingOsc.fill(nullptr);
         lastUnison.fill(-1);
 
         memset(audioInBuffer, 0, BLOCK_SIZE_OS * sizeof(float));
+        memset(voiceScenedata, 0, sizeof(voiceScenedata));
+        memset(sharedScenedata, 0, sizeof(sharedScenedata));
         setupSurgeCommon(NUM_PARAMS, VCOConfig<oscType>::requiresWavetables(), false);
 
         wavetableCount = storage->wt_list.size();
@@ -166,6 +186,14 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
         oscstorage_display = &(storage->getPatch().scene[0].osc[1]);
         oscstorage->type.val.i = oscType;
         oscstorage_display->type.val.i = oscType;
+        if constexpr (VCOConfig<oscType>::requiresWavetables())
+        {
+            oscstorage_spare = &(storage->getPatch().scene[0].osc[2]);
+            oscstorage_spare->type.val.i = oscType;
+            setupStorageRanges(&(oscstorage_spare->type), &(oscstorage_spare->retrigger));
+            spare_id_start = storage_id_start;
+            spare_id_end = storage_id_end;
+        }
         setupStorageRanges(&(oscstorage->type), &(oscstorage->retrigger));
 
         if constexpr (VCOConfig<oscType>::requiresWavetables())
@@ -176,12 +204,7 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
             }
             else if (!oscstorage->wt.everBuilt)
             {
-                oscstorage->wt.queue_id = 0;
-                oscstorage_display->wt.queue_id = 0;
-                storage->perform_queued_wtloads();
-
-                invalidateWavetableStreamingCache = true;
-                wavetableIndex = oscstorage->wt.current_id;
+                loadInitialWavetable();
             }
         }
 
@@ -205,6 +228,26 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
         display_osc->init(72.0, true);
 
         VCOConfig<oscType>::oscillatorSpecificSetup(this);
+        if constexpr (VCOVoiceBatch<oscType>::supported)
+            VCOConfig<oscType>::voiceBatchSelfTest(this);
+
+        Oscillator *spare_osc{nullptr};
+        if constexpr (VCOConfig<oscType>::requiresWavetables())
+        {
+            // The spare slot needs the same control types and setup as the active one
+            // since we swap them whenever a wavetable loads
+            spare_osc = spawn_osc(spawnOscType, storage.get(), oscstorage_spare,
+                                  storage->getPatch().scenedata[0], oscbuffer[0][0]);
+            VCOConfig<oscType>::postSpawnOscillatorChange(spare_osc);
+            spare_osc->init_ctrltypes();
+            spare_osc->init_default_values();
+            spare_osc->init_extra_config();
+
+            std::swap(oscstorage, oscstorage_spare);
+            VCOConfig<oscType>::oscillatorSpecificSetup(this);
+            std::swap(oscstorage, oscstorage_spare);
+        }
+        publishedOscStorage.store(oscstorage, std::memory_order_release);
 
         for (int i = 0; i < n_osc_params; ++i)
         {
@@ -255,6 +298,8 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
         VCOConfig<oscType>::configureVCOSpecificParameters(this);
         config_osc->~Oscillator();
         display_osc->~Oscillator();
+        if (spare_osc)
+            spare_osc->~Oscillator();
 
         resetHalfbandOut();
 
@@ -274,6 +319,29 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
         memset(modulationDisplayValues, 0, (n_osc_params + 1) * sizeof(float));
         modAssist.initialize(this);
         snapCalculatedNames();
+
+        if constexpr (VCOConfig<oscType>::requiresWavetables())
+        {
+            startWavetableLoader();
+        }
+    }
+
+    void loadInitialWavetable()
+    {
+        oscstorage->wt.queue_id = 0;
+        storage->perform_queued_wtloads();
+
+        invalidateWavetableStreamingCache = true;
+        wavetableIndex = oscstorage->wt.current_id;
+        publishWavetableDisplaySnapshot(oscstorage);
+        borrowDisplayWavetable(oscstorage);
+        displayBuiltVersion = wavetableDisplayVersion;
+    }
+
+    void startWavetableLoader()
+    {
+        wavetableLoaderRunning = true;
+        wavetableLoaderThread = std::make_unique<std::thread>([this]() { wavetableLoaderLoop(); });
     }
 
     void setHalfbandCharacteristics(int M, bool steep)
@@ -319,13 +387,20 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
             if (surge_osc[i])
                 surge_osc[i]->~Oscillator();
             surge_osc[i] = nullptr;
+            if (fadingOsc[i])
+                fadingOsc[i]->~Oscillator();
+            fadingOsc[i] = nullptr;
         }
 
         if (VCOConfig<oscType>::requiresWavetables())
         {
-            std::lock_guard<std::mutex> mg(loadWavetableSpawnMutex);
-            if (loadWavetableThread)
-                loadWavetableThread->join();
+            {
+                std::lock_guard<std::mutex> lk(wavetableLoaderMutex);
+                wavetableLoaderRunning = false;
+            }
+            wavetableLoaderCV.notify_all();
+            if (wavetableLoaderThread)
+                wavetableLoaderThread->join();
         }
     }
 
@@ -340,7 +415,8 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
     {
         if (paramId >= OSC_CTRL_PARAM_0 && paramId <= OSC_CTRL_PARAM_0 + n_osc_params)
         {
-            return oscstorage->p[paramId - OSC_CTRL_PARAM_0].is_bipolar();
+            // the display storage has the same control types and never swaps
+            return oscstorage_display->p[paramId - OSC_CTRL_PARAM_0].is_bipolar();
         }
         if (paramId == PITCH_0)
         {
@@ -353,7 +429,8 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
     {
         if (!VCOConfig<oscType>::requiresWavetables())
             return false;
-        return (oscstorage->wt.flags & wtf_is_sample);
+        auto snap = std::atomic_load(&wavetableDisplaySnapshot);
+        return snap && (snap->flags & wtf_is_sample);
     }
 
     float modulationDisplayValues[n_osc_params + 1];
@@ -407,6 +484,28 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
     std::atomic<bool> invalidateWavetableStreamingCache{true};
     std::string wavetableStreamingCache;
 
+    /*
+     * With storeWavetablesByDigest on the patch carries only a digest into the shared
+     * WavetableStore rather than the base64 table. wavetableStreamingData is the streamed
+     * blob both forms are made from; once stored it is the store's shared copy.
+     */
+    std::atomic<bool> storeWavetablesByDigest{false};
+
+    // Opt in to restoring loads from the on disk WavetableBuildCache
+    std::atomic<bool> useWavetableBuildCache{false};
+    WavetableStore::blobPtr_t wavetableStreamingData;
+    std::string wavetableStreamingDigest;
+
+    /*
+     * A restored slot aliases the store's shared build of its table rather than building
+     * its own, and holds it here until the slot is built again. These swap with the slots.
+     */
+    WavetableStore::tablePtr_t sharedWavetable, spareSharedWavetable;
+
+    // Set when a patch names a stored table this machine doesn't have
+    std::atomic<bool> wavetableMissing{false};
+    std::string missingWavetableName;
+
     uint32_t lastWavetableLoads{0};
     std::atomic<bool> draw3DWavetable{VCOConfig<oscType>::requiresWavetables()};
     std::atomic<bool> animateDisplayFromMod{true};
@@ -417,49 +516,402 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
     {
         if (wavetableCount == 0)
             return "ERROR: NO WAVETABLES";
+        if (wavetableMissing)
+            return "MISSING: " + missingWavetableName;
         int idx = wavetableIndex;
         if (idx >= 0)
             return storage->wt_list[idx].name;
-        else
-            return oscstorage->wavetable_display_name;
+        auto snap = std::atomic_load(&wavetableDisplaySnapshot);
+        return snap ? snap->displayName : std::string{};
     }
 
     std::array<int, MAX_POLY> lastUnison{-1};
     int lastNChan{-1};
     bool forceRespawnDueToSampleRate = false;
-    static constexpr int checkWaveTableEvery{512};
-    int checkedWaveTable{checkWaveTableEvery};
     static constexpr int calcModMatrixEvery{256};
     int calcedModMatrix{calcModMatrixEvery};
-    std::atomic<bool> suspendForWT{false};
-    std::unique_ptr<std::thread> loadWavetableThread;
-    std::mutex loadWavetableSpawnMutex;
 
+    /*
+     * Wavetables are double buffered across two oscillator storage slots. A persistent
+     * loader thread drains the wavetable queue and builds the table into the spare slot
+     * while audio keeps running on the active one, then moves wavetableSwapState to
+     * pending. The audio thread claims the swap at the next block boundary, swaps the slots,
+     * crossfades that block from the old oscillators and returns the state to idle, after
+     * which the (now spare) old slot may be built again. So the audio thread never creates
+     * or joins a thread, never takes a lock and never stops producing sound during a load.
+     *
+     * Every build into the spare, from the loader or from a patch restore, happens under
+     * wavetableBuildMutex, and a restore cancels any swap which hasn't started yet, so a
+     * stale queued load can never land on top of a restored table.
+     */
+    enum WavetableSwapState
+    {
+        swapIdle,
+        swapPending,
+        swapInProgress
+    };
+    OscillatorStorage *oscstorage_spare{nullptr};
+    int spare_id_start{0}, spare_id_end{0};
+    std::atomic<int> wavetableSwapState{swapIdle};
+    std::atomic<bool> wavetableLoaderRunning{false};
+    std::unique_ptr<std::thread> wavetableLoaderThread;
+    std::mutex wavetableLoaderMutex, wavetableBuildMutex;
+    std::condition_variable wavetableLoaderCV;
+
+    // UI thread
+    void queueWavetableLoad(const WavetableMessage &msg)
+    {
+        wavetableQueue.push(msg);
+        notifyWavetableLoader();
+    }
+
+    void notifyWavetableLoader()
+    {
+        {
+            std::lock_guard<std::mutex> lk(wavetableLoaderMutex);
+        }
+        wavetableLoaderCV.notify_one();
+    }
+
+    void wavetableLoaderLoop()
+    {
+        bool retrySoon{false};
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lk(wavetableLoaderMutex);
+                auto ready = [this]() {
+                    return !wavetableLoaderRunning || !wavetableQueue.empty();
+                };
+                /*
+                 * Idle we sleep until a load is queued. The audio thread doesn't signal us
+                 * when it takes a swap, so only with a load queued behind a swap which
+                 * hasn't finished do we poll, and that lasts a block or two.
+                 */
+                if (retrySoon)
+                    wavetableLoaderCV.wait_for(lk, std::chrono::milliseconds(5), ready);
+                else
+                    wavetableLoaderCV.wait(lk, ready);
+            }
+            if (!wavetableLoaderRunning)
+                break;
+
+            std::lock_guard<std::mutex> bg(wavetableBuildMutex);
+            retrySoon = wavetableSwapState != swapIdle;
+            if (retrySoon || wavetableQueue.empty())
+                continue;
+
+            claimSpareForBuild();
+            WavetableMessage msg;
+            while (!wavetableQueue.empty())
+            {
+                msg = wavetableQueue.shift();
+            }
+            loadWavetable(msg);
+        }
+    }
+
+    /*
+     * UI thread. The loader reads wt_list while it builds, so the catalog is only replaced
+     * between builds. An explicit rescan waits for the build in flight; picking up another
+     * module's rescan just tries again next frame if the loader is busy.
+     */
+    void refreshWavetableCatalogBetweenBuilds()
+    {
+        std::lock_guard<std::mutex> bg(wavetableBuildMutex);
+        appliedWavetableCatalogGeneration = refreshWavetableCatalog(storage.get());
+    }
+
+    void syncWavetableCatalogBetweenBuilds()
+    {
+        if (wavetableCatalogGeneration() == appliedWavetableCatalogGeneration)
+            return;
+        std::unique_lock<std::mutex> bg(wavetableBuildMutex, std::try_to_lock);
+        if (bg.owns_lock())
+            syncWavetableCatalog();
+    }
+
+    // Loader thread, holding wavetableBuildMutex
     void loadWavetable(WavetableMessage msg)
     {
+        // Nothing aliases the spare now so it can let go of any shared table
+        spareSharedWavetable.reset();
+        wavetableMissing = false;
+
+        bool useCache = useWavetableBuildCache;
         if (msg.index >= 0)
         {
             auto nid = std::clamp((int)msg.index, (int)0, (int)storage->wt_list.size());
-            oscstorage->wt.queue_id = nid;
-            oscstorage_display->wt.queue_id = nid;
-            storage->perform_queued_wtloads();
+            auto src = nid < (int)storage->wt_list.size() ? storage->wt_list[nid].path : fs::path{};
+            auto frameSize = oscstorage_spare->wt.frame_size_if_absent;
+            if (!useCache || !WavetableBuildCache::restore(src, frameSize, nid, storage.get(),
+                                                           oscstorage_spare))
+            {
+                oscstorage_spare->wt.queue_id = nid;
+                storage->perform_queued_wtloads();
+                if (useCache)
+                    WavetableBuildCache::save(src, frameSize, oscstorage_spare);
+            }
 
-            invalidateWavetableStreamingCache = true;
-            wavetableIndex = oscstorage->wt.current_id;
+            wavetableIndex = oscstorage_spare->wt.current_id;
         }
         else
         {
-            oscstorage->wt.queue_filename = msg.filename;
-            oscstorage_display->wt.queue_filename = msg.filename;
-            oscstorage->wt.frame_size_if_absent = msg.defaultSize;
-            oscstorage_display->wt.frame_size_if_absent = msg.defaultSize;
-            storage->perform_queued_wtloads();
+            auto src = fs::path{msg.filename};
+            if (!useCache || !WavetableBuildCache::restore(src, msg.defaultSize, -1, storage.get(),
+                                                           oscstorage_spare))
+            {
+                oscstorage_spare->wt.queue_filename = msg.filename;
+                oscstorage_spare->wt.frame_size_if_absent = msg.defaultSize;
+                storage->perform_queued_wtloads();
+                if (useCache)
+                    WavetableBuildCache::save(src, msg.defaultSize, oscstorage_spare);
+            }
 
-            invalidateWavetableStreamingCache = true;
             wavetableIndex = -1;
         }
+        {
+            std::lock_guard<std::mutex> g(displayBorrowMutex);
+            slotBeingBuilt = nullptr;
+        }
+        // The spare is ours until we mark the swap pending so we can read it to publish
+        publishWavetableDisplaySnapshot(oscstorage_spare);
+        invalidateWavetableStreamingCache = true;
+        wavetableSwapState = swapPending;
         wavetableLoads++;
-        suspendForWT = false;
+    }
+
+    /*
+     * The display storage builds no table of its own. It borrows the built table of
+     * whichever audio slot the latest snapshot names by aliasing that slot's table
+     * pointers, so each VCO holds and builds one copy of its wavetable. A borrowed slot
+     * is immutable while borrowed: before it builds into the spare the loader moves the
+     * display onto the active slot itself, and the display will not borrow the slot being
+     * built. So a load never waits on the UI, which may not be stepping at all.
+     *
+     * displayBorrowMutex guards the borrow, displayBuiltVersion (the snapshot version the
+     * display holds) and every UI read of the display tables, so the plot renders without
+     * the storage wavetable mutex. The audio thread never takes it.
+     */
+    struct WavetableDisplaySnapshot
+    {
+        uint32_t version{0};
+        OscillatorStorage *slot{nullptr};
+        // copied at publish time so the UI never reads a slot which may be rebuilt
+        std::string displayName;
+        int flags{0};
+    };
+    std::shared_ptr<const WavetableDisplaySnapshot> wavetableDisplaySnapshot;
+    std::atomic<uint32_t> wavetableDisplayVersion{0};
+    uint32_t displayBuiltVersion{0};
+    std::mutex displayBorrowMutex;
+    OscillatorStorage *displayBorrowedSlot{nullptr}, *slotBeingBuilt{nullptr};
+
+    void publishWavetableDisplaySnapshot(OscillatorStorage *from)
+    {
+        auto res = std::make_shared<WavetableDisplaySnapshot>();
+        res->slot = from;
+        res->displayName = from->wavetable_display_name;
+        res->flags = from->wt.flags;
+        res->version = ++wavetableDisplayVersion;
+        std::atomic_store(&wavetableDisplaySnapshot,
+                          std::shared_ptr<const WavetableDisplaySnapshot>(res));
+    }
+
+    // Loader thread with no swap pending, or a restore; holding wavetableBuildMutex
+    void claimSpareForBuild()
+    {
+        std::lock_guard<std::mutex> g(displayBorrowMutex);
+        reclaimDisplayFromSpare();
+        slotBeingBuilt = oscstorage_spare;
+    }
+
+    /*
+     * Caller holds displayBorrowMutex. If the display still borrows the spare (say the UI
+     * hasn't stepped since the last swap) point it at the active slot, which can't change
+     * while no swap is pending. Clearing displayBuiltVersion has the UI reapply the latest
+     * snapshot and redraw.
+     */
+    void reclaimDisplayFromSpare()
+    {
+        if (displayBorrowedSlot != oscstorage_spare)
+            return;
+        borrowDisplayWavetable(oscstorage);
+        displayBuiltVersion = 0;
+    }
+
+    void borrowDisplayWavetable(OscillatorStorage *from)
+    {
+        aliasWavetable(oscstorage_display->wt, from->wt);
+        oscstorage_display->wavetable_display_name = from->wavetable_display_name;
+        displayBorrowedSlot = from;
+    }
+
+    // Points dst at src's built tables. src must outlive every use of dst.
+    static void aliasWavetable(Wavetable &dst, const Wavetable &src)
+    {
+        dst.size = src.size;
+        dst.n_tables = src.n_tables;
+        dst.size_po2 = src.size_po2;
+        dst.flags = src.flags;
+        dst.dt = src.dt;
+        dst.everBuilt = src.everBuilt;
+        dst.current_id = src.current_id;
+        memcpy(dst.TableF32WeakPointers, src.TableF32WeakPointers,
+               sizeof(dst.TableF32WeakPointers));
+        memcpy(dst.TableI16WeakPointers, src.TableI16WeakPointers,
+               sizeof(dst.TableI16WeakPointers));
+    }
+
+    // UI thread. Returns true if the display storage moved to a new table.
+    bool applyWavetableDisplaySnapshot()
+    {
+        auto snap = std::atomic_load(&wavetableDisplaySnapshot);
+        if (!snap)
+            return false;
+
+        std::lock_guard<std::mutex> g(displayBorrowMutex);
+        if (snap->version == displayBuiltVersion || snap->slot == slotBeingBuilt)
+            return false;
+        borrowDisplayWavetable(snap->slot);
+        displayBuiltVersion = snap->version;
+        return true;
+    }
+
+    /*
+     * Audio thread, at a block boundary. The oscillators point at the old slot so new ones
+     * are spawned onto the new slot in the other oscillator bank. The old ones run one more
+     * block so the new table fades in over it rather than restarting every voice's phase
+     * with a click; finishWavetableCrossfade then drops them and only then returns the
+     * swap state to idle, so the loader can't rebuild the old slot under them.
+     */
+    void swapInSpareWavetableSlot()
+    {
+        std::swap(oscstorage, oscstorage_spare);
+        std::swap(storage_id_start, spare_id_start);
+        std::swap(storage_id_end, spare_id_end);
+        std::swap(sharedWavetable, spareSharedWavetable);
+        publishedOscStorage.store(oscstorage, std::memory_order_release);
+
+        fadingOsc = surge_osc;
+        surge_osc.fill(nullptr);
+        oscBank = (oscBank + 1) % oscBanks;
+
+        lastUnison.fill(-1);
+        lastNChan = -1;
+        forceSharedScenedata = true;
+    }
+
+    void crossfadeFromFadingOsc(int c, bool gated, float pitch0, float driftVal)
+    {
+        auto *fo = fadingOsc[c];
+        fo->setGate(gated);
+        fo->process_block(pitch0, driftVal, true);
+        for (int i = 0; i < BLOCK_SIZE_OS; ++i)
+        {
+            auto t = (i + 1) * (1.f / BLOCK_SIZE_OS);
+            osc_downsample[0][c][i] = t * osc_downsample[0][c][i] + (1 - t) * fo->output[i];
+            osc_downsample[1][c][i] = t * osc_downsample[1][c][i] + (1 - t) * fo->outputR[i];
+        }
+    }
+
+    // The half band, output level and DC blocker stages for one voice's block
+    void finishVoiceBlock(int c)
+    {
+        halfbandOUT[c]->process_block_D2(osc_downsample[0][c], osc_downsample[1][c],
+                                         BLOCK_SIZE_OS);
+
+        auto fa = params[FIXED_ATTENUATION].getValue();
+        for (int i = 0; i < BLOCK_SIZE; ++i)
+        {
+            osc_downsample[0][c][i] *= fa;
+            osc_downsample[1][c][i] *= fa;
+        }
+        if (doDCBlock)
+        {
+            // DC BLOCK HERE
+            blockers[0][c].filter(osc_downsample[0][c]);
+            blockers[1][c].filter(osc_downsample[1][c]);
+        }
+    }
+
+    /*
+     * Decides which engine voice c runs on this block and returns true if it is the
+     * batch. A voice only moves onto the batch when it (re)starts, since the scalar
+     * oscillator's phase can't be carried over. A batch voice whose settings stop being
+     * eligible restarts its scalar oscillator and fades across from the batch over this
+     * block, which processVoiceBatch finishes.
+     */
+    bool routeVoiceToBatch(int c, bool &needsReInit, bool eligible, float pitch0)
+    {
+        auto &vb = voiceBatch;
+        bool fresh = needsReInit || vb.pendingStart[c];
+        vb.pendingStart[c] = false;
+        vb.omega[c] = VCOVoiceBatch<oscType>::omegaFor(storage.get(), pitch0);
+
+        if (eligible && (vb.active[c] || fresh))
+        {
+            if (fresh)
+            {
+                auto ph = oscstorage->retrigger.val.b ? 0.f : storage->rand_01() * 2.f - 1.f;
+                vb.start(c, ph * (float)M_PI);
+            }
+            vb.active[c] = true;
+            return true;
+        }
+        if (vb.active[c])
+        {
+            vb.active[c] = false;
+            vb.fadingOut[c] = true;
+            needsReInit = true;
+        }
+        return false;
+    }
+
+    void processVoiceBatch(int nChan)
+    {
+        auto &vb = voiceBatch;
+        bool any{false};
+        for (int c = 0; c < nChan; ++c)
+            any = any || vb.active[c] || vb.fadingOut[c];
+        if (!any)
+            return;
+
+        vb.process(nChan);
+        for (int c = 0; c < nChan; ++c)
+        {
+            if (vb.active[c])
+            {
+                sst::basic_blocks::mechanics::copy_from_to<BLOCK_SIZE_OS>(vb.output[c],
+                                                                          osc_downsample[0][c]);
+                sst::basic_blocks::mechanics::copy_from_to<BLOCK_SIZE_OS>(vb.output[c],
+                                                                          osc_downsample[1][c]);
+                finishVoiceBlock(c);
+            }
+            else if (vb.fadingOut[c])
+            {
+                for (int i = 0; i < BLOCK_SIZE_OS; ++i)
+                {
+                    auto t = (i + 1) * (1.f / BLOCK_SIZE_OS);
+                    auto from = (1 - t) * vb.output[c][i];
+                    osc_downsample[0][c][i] = t * osc_downsample[0][c][i] + from;
+                    osc_downsample[1][c][i] = t * osc_downsample[1][c][i] + from;
+                }
+                vb.fadingOut[c] = false;
+                finishVoiceBlock(c);
+            }
+        }
+    }
+
+    void finishWavetableCrossfade()
+    {
+        for (auto &fo : fadingOsc)
+        {
+            if (fo)
+                fo->~Oscillator();
+            fo = nullptr;
+        }
+        wavetableSwapState = swapIdle;
     }
 
     void process(const typename rack::Module::ProcessArgs &args) override
@@ -476,32 +928,11 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
             if (wavetableCount == 0)
                 return;
 
-            if (suspendForWT)
-                return;
-
-            if (checkedWaveTable >= checkWaveTableEvery)
+            int expected = swapPending;
+            if (processPosition >= BLOCK_SIZE &&
+                wavetableSwapState.compare_exchange_strong(expected, swapInProgress))
             {
-                checkedWaveTable = 0;
-
-                bool read{false};
-                WavetableMessage msg;
-                while (!wavetableQueue.empty())
-                {
-                    msg = wavetableQueue.shift();
-                    read = true;
-                }
-
-                if (read)
-                {
-                    std::lock_guard<std::mutex> mg(loadWavetableSpawnMutex);
-                    if (loadWavetableThread)
-                        loadWavetableThread->join();
-                    loadWavetableThread =
-                        std::make_unique<std::thread>([msg, this]() { this->loadWavetable(msg); });
-                    suspendForWT = true;
-                    // loadWavetable(msg);
-                    return;
-                }
+                swapInSpareWavetableSlot();
             }
         }
 
@@ -529,6 +960,7 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
             }
 
             copyScenedataSubset(0, storage_id_start, storage_id_end);
+            resolveSharedScenedata(true);
 
             for (int c = 0; c < nChan; ++c)
             {
@@ -538,7 +970,7 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
                 if (!surge_osc[c])
                 {
                     surge_osc[c] = spawn_osc(spawnOscType, storage.get(), oscstorage,
-                                             storage->getPatch().scenedata[0], oscbuffer[c]);
+                                             voiceScenedata[c], oscbuffer[oscBank][c]);
                     VCOConfig<oscType>::postSpawnOscillatorChange(surge_osc[c]);
 
                     // We want to make sure the correct init is always called here not the override
@@ -549,6 +981,8 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
                     // But this oscillator has already been initialized so let the override in
                     VCOConfig<oscType>::oscillatorReInit(this, surge_osc[c], pitch0);
                 }
+                if constexpr (VCOVoiceBatch<oscType>::supported)
+                    voiceBatch.pendingStart[c] = true;
             }
             forceRespawnDueToSampleRate = false;
             processPosition = BLOCK_SIZE + 1;
@@ -617,6 +1051,39 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
             storage->getPatch().character.val.i = characterFilter;
             auto driftVal = std::clamp(params[DRIFT].getValue(), 0.f, 1.f);
 
+            oscstorage->retrigger.val.b = (params[RETRIGGER_STYLE].getValue() > 0.5);
+            if constexpr (VCOConfig<oscType>::supportsUnison())
+            {
+                auto extendDetune = params[EXTEND_UNISON].getValue() > 0.5;
+                auto absoluteDetune = params[ABSOLUTE_UNISON].getValue() > 0.5;
+                // We need the display here because it is used for formatting
+                if (oscstorage->p[n_osc_params - 2].extend_range != extendDetune)
+                {
+                    oscstorage->p[n_osc_params - 2].set_extend_range(extendDetune);
+                    oscstorage_display->p[n_osc_params - 2].set_extend_range(extendDetune);
+                }
+                oscstorage->p[n_osc_params - 2].absolute = absoluteDetune;
+                oscstorage_display->p[n_osc_params - 2].absolute = absoluteDetune;
+            }
+
+            // Unmodulated parameters are the same for every voice so resolve them once
+            for (int i = 0; i < n_osc_params; ++i)
+            {
+                auto pv = modAssist.connectedParameter[i + 1];
+                if (!pv)
+                    oscstorage->p[i].set_value_f01(modAssist.basevalues[i + 1]);
+                if (pv != voiceModulated[i])
+                {
+                    voiceModulated[i] = pv;
+                    forceSharedScenedata = true;
+                }
+            }
+            resolveSharedScenedata(forceSharedScenedata);
+
+            bool batchThisBlock{false};
+            if constexpr (VCOVoiceBatch<oscType>::supported)
+                batchThisBlock = VCOConfig<oscType>::voiceBatchEligible(this, driftVal);
+
             for (int c = 0; c < nChan; ++c)
             {
                 bool needsReInit{reInitEveryOSC};
@@ -641,9 +1108,16 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
 
                 if (outputs[OUTPUT_L].isConnected() || outputs[OUTPUT_R].isConnected())
                 {
+                    // Only the modulated parameters differ per voice. We still set them on
+                    // the oscillator storage since some oscillators read it directly.
                     for (int i = 0; i < n_osc_params; ++i)
                     {
-                        oscstorage->p[i].set_value_f01(modAssist.values[i + 1][c]);
+                        if (voiceModulated[i])
+                        {
+                            auto &par = oscstorage->p[i];
+                            par.set_value_f01(modAssist.values[i + 1][c]);
+                            voiceScenedata[c][par.param_id_in_scene].i = par.val.i;
+                        }
                     }
                     if constexpr (VCOConfig<oscType>::supportsUnison())
                     {
@@ -654,26 +1128,16 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
                         }
                     }
 
-                    oscstorage->retrigger.val.b = (params[RETRIGGER_STYLE].getValue() > 0.5);
-                    if constexpr (VCOConfig<oscType>::supportsUnison())
-                    {
-                        auto extendDetune = params[EXTEND_UNISON].getValue() > 0.5;
-                        auto absoluteDetune = params[ABSOLUTE_UNISON].getValue() > 0.5;
-                        // We need the display here because it is used for formatting
-                        if (oscstorage->p[n_osc_params - 2].extend_range != extendDetune)
-                        {
-                            oscstorage->p[n_osc_params - 2].set_extend_range(extendDetune);
-                            oscstorage_display->p[n_osc_params - 2].set_extend_range(extendDetune);
-                        }
-                        oscstorage->p[n_osc_params - 2].absolute = absoluteDetune;
-                        oscstorage_display->p[n_osc_params - 2].absolute = absoluteDetune;
-                    }
-
                     float pitch0 =
                         (modAssist.values[0][c] + 5) * 12 +
                         (params[OCTAVE_SHIFT].getValue() + inputs[PITCH_CV].getVoltage(c)) * 12;
 
-                    copyScenedataSubset(0, storage_id_start, storage_id_end);
+                    if constexpr (VCOVoiceBatch<oscType>::supported)
+                    {
+                        if (routeVoiceToBatch(c, needsReInit, batchThisBlock, pitch0))
+                            continue;
+                    }
+
                     if (needsReInit)
                     {
                         // surge_osc[c]->init(pitch0);
@@ -685,23 +1149,32 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
                                                                               osc_downsample[0][c]);
                     sst::basic_blocks::mechanics::copy_from_to<BLOCK_SIZE_OS>(surge_osc[c]->outputR,
                                                                               osc_downsample[1][c]);
-                    halfbandOUT[c]->process_block_D2(osc_downsample[0][c], osc_downsample[1][c],
-                                                     BLOCK_SIZE_OS);
-
-                    auto fa = params[FIXED_ATTENUATION].getValue();
-                    for (int i = 0; i < BLOCK_SIZE; ++i)
+                    if constexpr (VCOConfig<oscType>::requiresWavetables())
                     {
-                        osc_downsample[0][c][i] *= fa;
-                        osc_downsample[1][c][i] *= fa;
+                        if (fadingOsc[c])
+                            crossfadeFromFadingOsc(c, gated, pitch0, driftVal);
                     }
-                    if (doDCBlock)
+                    if constexpr (VCOVoiceBatch<oscType>::supported)
                     {
-                        // DC BLOCK HERE
-                        blockers[0][c].filter(osc_downsample[0][c]);
-                        blockers[1][c].filter(osc_downsample[1][c]);
+                        // finished once the batch it fades from has run
+                        if (voiceBatch.fadingOut[c])
+                            continue;
                     }
+                    finishVoiceBlock(c);
                 }
             }
+
+            if constexpr (VCOVoiceBatch<oscType>::supported)
+            {
+                if (outputs[OUTPUT_L].isConnected() || outputs[OUTPUT_R].isConnected())
+                    processVoiceBatch(nChan);
+            }
+
+            if constexpr (VCOConfig<oscType>::requiresWavetables())
+            {
+                if (wavetableSwapState == swapInProgress)
+                    finishWavetableCrossfade();
+            }
             // pc.update(this);
         }
 
@@ -738,16 +1211,56 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
         }
 
         processPosition++;
-        checkedWaveTable++;
         calcedModMatrix++;
     }
 
+    /*
+     * Each voice's oscillator reads its own copy of the scene data rather than the patch's
+     * shared scenedata, so we don't have to rewrite the storage and re-copy the whole
+     * oscillator range once per channel. Unmodulated values are resolved once a block and
+     * only pushed to the voices when they change; modulated ones are written per voice.
+     */
+    pdata voiceScenedata alignas(16)[MAX_POLY][n_scene_params];
+    pdata sharedScenedata alignas(16)[n_scene_params];
+    std::array<bool, n_osc_params> voiceModulated{};
+    bool forceSharedScenedata{true};
+
+    void resolveSharedScenedata(bool force)
+    {
+        auto &patch = storage->getPatch();
+        int s = patch.scene_start[0];
+        int nc = force ? MAX_POLY : std::max(lastNChan, 1);
+        int p0 = oscstorage->p[0].id;
+        for (int i = storage_id_start; i < storage_id_end; ++i)
+        {
+            auto op = i - p0;
+            if (!force && op >= 0 && op < n_osc_params && voiceModulated[op])
+                continue;
+
+            auto v = patch.param_ptr[i]->val.i;
+            if (force || sharedScenedata[i - s].i != v)
+            {
+                sharedScenedata[i - s].i = v;
+                for (int c = 0; c < nc; ++c)
+                    voiceScenedata[c][i - s].i = v;
+            }
+        }
+        forceSharedScenedata = false;
+    }
+
     // With surge-xt the oscillator memory is owned by the synth after spawn
     std::array<Oscillator *, MAX_POLY> surge_osc;
-    unsigned char oscbuffer alignas(16)[MAX_POLY][oscillator_buffer_size];
+    // Wavetable VCOs alternate oscillator banks so a swap can fade from the old bank
+    static constexpr int oscBanks{VCOConfig<oscType>::requiresWavetables() ? 2 : 1};
+    int oscBank{0};
+    std::array<Oscillator *, MAX_POLY> fadingOsc;
+    VCOVoiceBatch<oscType> voiceBatch;
+    unsigned char oscbuffer alignas(16)[oscBanks][MAX_POLY][oscillator_buffer_size];
     unsigned char oscdisplaybuffer alignas(16)[2][oscillator_buffer_size];
 
     OscillatorStorage *oscstorage, *oscstorage_display;
+    // oscstorage as of the last swap, for the UI thread
+    std::atomic<OscillatorStorage *> publishedOscStorage{nullptr};
     float osc_downsample alignas(16)[2][MAX_POLY][BLOCK_SIZE_OS];
     modules::DCBlocker blockers[2][MAX_POLY];
     int halfbandM{6};
@@ -765,18 +1278,28 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
         auto vco = json_object();
         if (VCOConfig<oscType>::requiresWavetables() && wavetableCount > 0)
         {
+            /*
+             * Save the latest built table, which is the one the last snapshot names. That
+             * is the spare while a swap is pending, so a save straight after a load or a
+             * restore doesn't write the table being replaced. Holding the build mutex
+             * keeps the loader from starting on that slot while we read it.
+             */
+            std::lock_guard<std::mutex> bg(wavetableBuildMutex);
+            auto snap = std::atomic_load(&wavetableDisplaySnapshot);
+            auto *latest = snap ? snap->slot : oscstorage;
+
             auto *wtT = json_object();
             json_object_set_new(wtT, "draw3D", json_boolean(draw3DWavetable));
 
             json_object_set_new(wtT, "display_name",
-                                json_string(oscstorage->wavetable_display_name.c_str()));
+                                json_string(latest->wavetable_display_name.c_str()));
 
-            auto &wt = oscstorage->wt;
+            auto &wt = latest->wt;
             json_object_set_new(wtT, "n_tables", json_integer(wt.n_tables));
             json_object_set_new(wtT, "n_samples", json_integer(wt.size));
             json_object_set_new(wtT, "flags", json_integer(wt.flags));
 
-            if (invalidateWavetableStreamingCache)
+            if (invalidateWavetableStreamingCache.exchange(false))
             {
                 wt_header wth;
                 memset(wth.tag, 0, 4);
@@ -786,8 +1309,8 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
                 unsigned int wtsize =
                     wth.n_samples * wt.n_tables * sizeof(uint16_t) + sizeof(wt_header);
 
-                auto *data = new uint8_t[wtsize];
-                auto *odata = data;
+                auto blob = WavetableStore::blob_t(wtsize);
+                auto *data = blob.data();
                 memcpy(data, &wth, sizeof(wt_header));
                 data += sizeof(wt_header);
 
@@ -797,12 +1320,32 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
                                 wth.n_samples * sizeof(uint16_t));
                     data += wth.n_samples * sizeof(uint16_t);
                 }
-                wavetableStreamingCache = rack::string::toBase64(odata, wtsize);
+                wavetableStreamingData = std::make_shared<const WavetableStore::blob_t>(
+                    std::move(blob));
+                wavetableStreamingCache.clear();
+                wavetableStreamingDigest.clear();
+            }
 
-                delete[] odata;
-                invalidateWavetableStreamingCache = false;
+            if (storeWavetablesByDigest && wavetableStreamingDigest.empty())
+            {
+                wavetableStreamingData =
+                    WavetableStore::store(*wavetableStreamingData, wavetableStreamingDigest);
+            }
+
+            // If the store could not be written we fall back to embedding the table
+            if (storeWavetablesByDigest && !wavetableStreamingDigest.empty())
+            {
+                json_object_set_new(wtT, "digest", json_string(wavetableStreamingDigest.c_str()));
+            }
+            else
+            {
+                if (wavetableStreamingCache.empty())
+                {
+                    wavetableStreamingCache = rack::string::toBase64(
+                        wavetableStreamingData->data(), wavetableStreamingData->size());
+                }
+                json_object_set_new(wtT, "data", json_string(wavetableStreamingCache.c_str()));
             }
-            json_object_set_new(wtT, "data", json_string(wavetableStreamingCache.c_str()));
             json_object_set_new(vco, "wavetable", wtT);
             wtT = nullptr;
         }
@@ -810,9 +1353,10 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
         // A little bit of defensive code I added in 2.2 in case we change int bounds in the
         // future. I don't read this yet but I do write it
         auto *paramNatural = json_array();
+        auto *active = publishedOscStorage.load(std::memory_order_acquire);
         for (int i = 0; i < n_osc_params; ++i)
         {
-            const auto &p = oscstorage->p[i];
+            const auto &p = active->p[i];
             auto *parJ = json_object();
 
             json_object_set(parJ, "index", json_integer(i));
@@ -837,47 +1381,73 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
         json_object_set_new(vco, "halfbandSteep", json_boolean(halfbandSteep));
         json_object_set_new(vco, "doDCBlock", json_boolean(doDCBlock));
         json_object_set_new(vco, "displayPolyChannel", json_integer(displayPolyChannel));
+        if (VCOConfig<oscType>::requiresWavetables())
+        {
+            json_object_set_new(vco, "storeWavetablesByDigest",
+                                json_boolean(storeWavetablesByDigest));
+            json_object_set_new(vco, "wavetableBuildCache", json_boolean(useWavetableBuildCache));
+        }
         return vco;
     }
+    // UI thread, holding wavetableBuildMutex
+    void cancelPendingWavetableLoads()
+    {
+        while (!wavetableQueue.empty())
+            wavetableQueue.shift();
+        int expected = swapPending;
+        if (!wavetableSwapState.compare_exchange_strong(expected, swapIdle))
+        {
+            while (wavetableSwapState == swapInProgress)
+                std::this_thread::yield();
+        }
+    }
+
+    /*
+     * A patch saved with storeWavetablesByDigest only works where its store is. Opened
+     * elsewhere we say so, load the library table of the same name if there is one and
+     * otherwise keep the current table but show the missing name.
+     */
+    void restoreMissingWavetable(const std::string &digest, const std::string &dname,
+                                 int supposedIdx)
+    {
+        std::lock_guard<std::mutex> bg(wavetableBuildMutex);
+        cancelPendingWavetableLoads();
+        if (supposedIdx >= 0)
+        {
+            WARN("Wavetable store entry %s is missing; loading '%s' from the library",
+                 digest.c_str(), dname.c_str());
+            WavetableMessage msg;
+            msg.index = supposedIdx;
+            queueWavetableLoad(msg);
+            return;
+        }
+
+        WARN("Wavetable store entry %s for '%s' is missing", digest.c_str(), dname.c_str());
+        missingWavetableName = dname;
+        wavetableMissing = true;
+    }
+
     void readModuleSpecificJson(json_t *modJ) override
     {
         if (VCOConfig<oscType>::requiresWavetables())
         {
+            auto sbd = json_object_get(modJ, "storeWavetablesByDigest");
+            if (sbd)
+                storeWavetablesByDigest = json_boolean_value(sbd);
+            auto wbc = json_object_get(modJ, "wavetableBuildCache");
+            if (wbc)
+                useWavetableBuildCache = json_boolean_value(wbc);
+
             auto wtJ = json_object_get(modJ, "wavetable");
             if (!wtJ)
                 return;
-            auto dj = json_object_get(wtJ, "data");
-            if (!dj)
-                return;
-            auto *sv = json_string_value(dj);
-            if (!sv)
-                return;
-
-            auto d3 = json_object_get(wtJ, "draw3D");
-            if (d3)
-            {
-                draw3DWavetable = json_boolean_value(d3);
-            }
-
-            auto dataV = rack::string::fromBase64(sv);
-            auto *data = &dataV[0];
-
-            wt_header wth;
-            memcpy(&wth, data, sizeof(wt_header));
-            data += sizeof(wt_header);
-            storage->waveTableDataMutex.lock();
-            oscstorage->wt.BuildWT(data, wth, false);
-            oscstorage_display->wt.BuildWT(data, wth, false);
-            wavetableLoads++;
-
-            invalidateWavetableStreamingCache = true;
-            storage->waveTableDataMutex.unlock();
 
+            std::string dname;
+            int supposedIdx = -1;
             auto nm = json_object_get(wtJ, "display_name");
-            if (nm)
+            if (nm && json_string_value(nm))
             {
-                int supposedIdx = -1;
-                std::string dname = json_string_value(nm);
+                dname = json_string_value(nm);
                 int idx{0};
                 for (const auto &wt : storage->wt_list)
                 {
@@ -888,15 +1458,75 @@ struct VCO : public modules::XTModule, sst::rackhelpers::module_connector::Neigh
                     }
                     idx++;
                 }
+            }
 
-                oscstorage->wt.current_id = supposedIdx;
-                oscstorage->wavetable_display_name = dname;
+            // Prefer the shared store and fall back to embedded data from older patches
+            WavetableStore::blobPtr_t blob;
+            std::string digest, embedded;
+            auto dg = json_object_get(wtJ, "digest");
+            if (dg && json_string_value(dg))
+            {
+                digest = json_string_value(dg);
+                blob = WavetableStore::fetch(digest);
+            }
+            auto dj = json_object_get(wtJ, "data");
+            if (!blob && (!dj || !json_string_value(dj)))
+            {
+                if (!digest.empty())
+                    restoreMissingWavetable(digest, dname, supposedIdx);
+                return;
+            }
+            if (!blob)
+            {
+                embedded = json_string_value(dj);
+                blob = std::make_shared<const WavetableStore::blob_t>(
+                    rack::string::fromBase64(embedded.c_str()));
+                digest = WavetableStore::digestFor(*blob);
+            }
+            if (blob->size() < sizeof(wt_header))
+                return;
+            auto table = WavetableStore::build(digest, *blob);
+            if (!table)
+                return;
 
-                oscstorage_display->wt.current_id = supposedIdx;
-                oscstorage_display->wavetable_display_name = dname;
+            auto d3 = json_object_get(wtJ, "draw3D");
+            if (d3)
+            {
+                draw3DWavetable = json_boolean_value(d3);
+            }
+
+            /*
+             * Restore into the spare like any other load. With the build mutex held the
+             * loader is idle, so drop whatever it had queued and take back a swap the audio
+             * thread hasn't claimed yet; either would replace the table we restore here.
+             */
+            std::lock_guard<std::mutex> bg(wavetableBuildMutex);
+            cancelPendingWavetableLoads();
+            claimSpareForBuild();
 
-                wavetableIndex = supposedIdx;
+            storage->waveTableDataMutex.lock();
+            aliasWavetable(oscstorage_spare->wt, *table);
+            spareSharedWavetable = table;
+            wavetableMissing = false;
+            oscstorage_spare->wt.current_id = supposedIdx;
+            if (nm)
+                oscstorage_spare->wavetable_display_name = dname;
+            storage->waveTableDataMutex.unlock();
+            {
+                std::lock_guard<std::mutex> g(displayBorrowMutex);
+                slotBeingBuilt = nullptr;
             }
+            wavetableIndex = supposedIdx;
+            wavetableLoads++;
+
+            // The patch already holds this table's streamed form so a save needn't remake it
+            invalidateWavetableStreamingCache = false;
+            wavetableStreamingData = blob;
+            wavetableStreamingCache = embedded;
+            // an embedded table may not be in the store yet, so let a save put it there
+            wavetableStreamingDigest = embedded.empty() ? digest : std::string{};
+            publishWavetableDisplaySnapshot(oscstorage_spare);
+            wavetableSwapState = swapPending;
         }
 
         auto hbm = json_object_get(modJ, "halfbandM");
@@ -0,0 +1,207 @@
+/*
+ * SurgeXT for VCV Rack - a Surge Synth Team product
+ *
+ * A set of modules expressing Surge XT into the VCV Rack Module Ecosystem
+ *
+ * Copyright 2019 - 2024, Various authors, as described in the github
+ * transaction log.
+ *
+ * Surge XT for VCV Rack is released under the GNU General Public License
+ * 3.0 or later (GPL-3.0-or-later). A copy of the license is in this
+ * repository in the file "LICENSE" or at:
+ *
+ * or at https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * All source for Surge XT for VCV Rack is available at
+ * https://github.com/surge-synthesizer/surge-rack/
+ */
+
+#ifndef SURGE_XT_RACK_SRC_VOICEWORKERPOOL_H
+#define SURGE_XT_RACK_SRC_VOICEWORKERPOOL_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <sst/plugininfra/cpufeatures.h>
+
+#include "Semaphore.h"
+
+namespace sst::surgext_rack::modules
+{
+/*
+ * A small process wide pool of threads which the polyphonic FX can hand voices to at a
+ * block boundary. The caller claims whichever workers are idle, gives each a contiguous
+ * range of voices, runs the remaining range itself and then waits for the workers before
+ * returning, so the block completes in the same process() call and adds no latency. If
+ * every worker is claimed by another module the caller just runs everything inline.
+ *
+ * The workers are ordinary threads, so the audio thread never waits on one which hasn't
+ * been scheduled yet: once its own range is done it takes back every range whose worker
+ * hasn't started and runs it inline, and only waits on ranges already running.
+ *
+ * Modules which opt in hold a reference from the UI thread for the rest of their life; the
+ * first reference makes the pool and the last one joins its threads, so the pool never
+ * outlives the modules and nothing is joined at static destruction. The audio thread
+ * only uses the pool if it already exists. Handing a range to a worker takes no lock.
+ */
+struct VoiceWorkerPool
+{
+    typedef void (*job_t)(void *ctx, int from, int to);
+    static constexpr int maxWorkers{4};
+
+    static VoiceWorkerPool *existing() { return instancePtr().load(std::memory_order_acquire); }
+
+    // Not the audio thread
+    static void acquire()
+    {
+        std::lock_guard<std::mutex> g(lifetimeMutex());
+        if (refCount()++ == 0)
+        {
+            instance() = std::make_unique<VoiceWorkerPool>();
+            instancePtr().store(instance().get(), std::memory_order_release);
+        }
+    }
+
+    // Not the audio thread, and only once no module which acquired can still be processing
+    static void release()
+    {
+        std::lock_guard<std::mutex> g(lifetimeMutex());
+        if (--refCount() == 0)
+        {
+            instancePtr().store(nullptr, std::memory_order_release);
+            instance().reset();
+        }
+    }
+
+    VoiceWorkerPool()
+    {
+        auto hc = (int)std::thread::hardware_concurrency();
+        nWorkers = std::clamp(hc / 2, 1, maxWorkers);
+        for (int i = 0; i < nWorkers; ++i)
+            workers[i].thread = std::thread([w = &workers[i]]() { w->run(); });
+    }
+
+    ~VoiceWorkerPool()
+    {
+        for (int i = 0; i < nWorkers; ++i)
+        {
+            workers[i].stop.store(true, std::memory_order_release);
+            workers[i].wake.post();
+            workers[i].thread.join();
+        }
+    }
+
+    // Runs job over [0, n) and returns once every voice is done
+    void run(job_t job, void *ctx, int n)
+    {
+        std::array<Worker *, maxWorkers> claimed;
+        int nClaimed{0};
+        for (int i = 0; i < nWorkers && nClaimed < n - 1; ++i)
+        {
+            if (!workers[i].claimed.exchange(true, std::memory_order_acquire))
+                claimed[nClaimed++] = &workers[i];
+        }
+
+        if (nClaimed == 0)
+        {
+            job(ctx, 0, n);
+            return;
+        }
+
+        // Split as evenly as we can and keep the first range for ourselves
+        int slices = nClaimed + 1;
+        int from = n * 1 / slices;
+        for (int k = 0; k < nClaimed; ++k)
+        {
+            int to = n * (k + 2) / slices;
+            auto *w = claimed[k];
+            w->job = job;
+            w->ctx = ctx;
+            w->from = from;
+            w->to = to;
+            w->done.store(false, std::memory_order_relaxed);
+            w->taken.store(false, std::memory_order_release);
+            w->wake.post();
+            from = to;
+        }
+
+        job(ctx, 0, n / slices);
+
+        for (int k = 0; k < nClaimed; ++k)
+        {
+            auto *w = claimed[k];
+            if (!w->taken.exchange(true, std::memory_order_acq_rel))
+            {
+                // the worker hasn't woken yet; its late wake will see the range is gone
+                w->job(w->ctx, w->from, w->to);
+            }
+            else
+            {
+                while (!w->done.load(std::memory_order_acquire))
+                    std::this_thread::yield();
+            }
+            w->claimed.store(false, std::memory_order_release);
+        }
+    }
+
+  private:
+    struct Worker
+    {
+        std::thread thread;
+        Semaphore wake;
+        std::atomic<bool> claimed{false}, taken{true}, done{true}, stop{false};
+        job_t job{nullptr};
+        void *ctx{nullptr};
+        int from{0}, to{0};
+
+        void run()
+        {
+            // Run voices with the same denormal handling as the engine thread
+            auto fpuguard = sst::plugininfra::cpufeatures::FPUStateGuard();
+
+            while (true)
+            {
+                wake.wait();
+                if (stop.load(std::memory_order_acquire))
+                    return;
+                // taken was cleared with a release after the job was filled in; if it is
+                // already set the caller ran the range itself
+                if (taken.exchange(true, std::memory_order_acq_rel))
+                    continue;
+
+                job(ctx, from, to);
+                done.store(true, std::memory_order_release);
+            }
+        }
+    };
+
+    static std::atomic<VoiceWorkerPool *> &instancePtr()
+    {
+        static std::atomic<VoiceWorkerPool *> p{nullptr};
+        return p;
+    }
+    static std::mutex &lifetimeMutex()
+    {
+        static std::mutex m;
+        return m;
+    }
+    static int &refCount()
+    {
+        static int r{0};
+        return r;
+    }
+    static std::unique_ptr<VoiceWorkerPool> &instance()
+    {
+        static std::unique_ptr<VoiceWorkerPool> p;
+        return p;
+    }
+
+    std::array<Worker, maxWorkers> workers;
+    int nWorkers{1};
+};
+} // namespace sst::surgext_rack::modules
+#endif
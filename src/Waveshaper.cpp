@@ -67,6 +67,10 @@ struct WaveshaperWidget : widgets::XTModuleWidget
             menu->addChild(rack::createMenuItem("Apply DC Blocker", CHECKMARK(m->doDCBlock),
                                                 [m]() { m->doDCBlock = !m->doDCBlock; }));
 
+            menu->addChild(rack::createMenuItem(
+                "Audio Rate Modulation Inputs", CHECKMARK(m->audioRateModulation),
+                [m]() { m->audioRateModulation = !m->audioRateModulation; }));
+
             menu->addChild(rack::createMenuItem(
                 "Show Transform and Response", CHECKMARK(style()->getWaveshaperShowsBothCurves()),
                 [this]() {
@@ -95,10 +95,8 @@ struct Waveshaper : public modules::XTModule,
 
     Waveshaper() : XTModule()
     {
-        std::lock_guard<std::mutex> lgxt(xtSurgeCreateMutex);
-
         config(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS);
-        setupSurgeCommon(NUM_PARAMS, false, false);
+        setupSurgeSharedReadOnly(NUM_PARAMS);
 
         // FIXME attach formatters here
         configParam(DRIVE, -24, 24, 0, "Drive", "dB"); // UNITS
@@ -145,6 +143,12 @@ struct Waveshaper : public modules::XTModule,
         restackSIMD();
         resetWaveshaperRegisters();
 
+        /*
+         * Knobs are read once a block and ramped. By default the mod inputs are sampled once
+         * a block and ramped too, which is much cheaper and fine for CV rate modulation; with
+         * audioRateModulation on they are applied every sample.
+         */
+        offersAudioRateModulation = true;
         modulationAssistant.initialize(this);
 
         // initialize values, they can be used by the UI before processing if plugin is bypassed
@@ -205,6 +209,7 @@ struct Waveshaper : public modules::XTModule,
 
     std::atomic<int> displayPolyChannel{0};
     std::atomic<bool> doDCBlock{true};
+
     bool wasDoDCBlock{true};
     /*
      * This is a bit annoying - i don't want to break 2.0.3.0 patches by turning on
@@ -304,7 +309,11 @@ struct Waveshaper : public modules::XTModule,
         if (processPosition >= BLOCK_SIZE)
         {
             modulationAssistant.setupMatrix(this);
-            modulationAssistant.updateValues(this);
+            bool ar = audioRateModulation;
+            for (int i = 0; i < n_mod_inputs; ++i)
+                modulationAssistant.audioRate[i] = ar;
+            modulationAssistant.updateRampTargets(this, BLOCK_SIZE);
+            modulationAssistant.stepRamp(this);
 
             if (!wasDoDCBlockSetByJSON)
             {
@@ -405,7 +414,7 @@ struct Waveshaper : public modules::XTModule,
         }
         else
         {
-            modulationAssistant.updateValues(this);
+            modulationAssistant.stepRamp(this);
         }
 
         if (stereoStack && lastPolyL == lastPolyR && lastPolyR == 1)
@@ -0,0 +1,334 @@
+/*
+ * SurgeXT for VCV Rack - a Surge Synth Team product
+ *
+ * A set of modules expressing Surge XT into the VCV Rack Module Ecosystem
+ *
+ * Copyright 2019 - 2024, Various authors, as described in the github
+ * transaction log.
+ *
+ * Surge XT for VCV Rack is released under the GNU General Public License
+ * 3.0 or later (GPL-3.0-or-later). A copy of the license is in this
+ * repository in the file "LICENSE" or at:
+ *
+ * or at https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * All source for Surge XT for VCV Rack is available at
+ * https://github.com/surge-synthesizer/surge-rack/
+ */
+
+#ifndef SURGE_XT_RACK_SRC_WAVETABLEBUILDCACHE_H
+#define SURGE_XT_RACK_SRC_WAVETABLEBUILDCACHE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "SurgeXT.h"
+#include "rack.hpp"
+#include "filesystem/import.h"
+#include "WavetableStore.h"
+
+namespace sst::surgext_rack::vco
+{
+/*
+ * An on disk cache of fully built wavetables in SurgeXTRack/WavetableCache. An entry is
+ * the Wavetable's float and int16 buffers as BuildWT left them, every mip level included,
+ * with the table pointers stored as offsets into those buffers. A warm load reads the
+ * entry straight into the slot's buffers and rebuilds the pointers rather than parsing
+ * the source and making the mips again.
+ *
+ * Entries are named by the source path, a SHA-256 of the source's contents and the
+ * requested frame size, so an edited source misses even if its mtime and size survive.
+ * The content hash is remembered against the source's mtime and size, so a source is only
+ * read and hashed again when its stat changes. Restore sizes the slot's buffers the way
+ * the original build had them before copying in, so a cold slot restores too.
+ *
+ * The directory is capped at maxCacheBytes. A hit touches its entry and each save evicts
+ * the least recently used entries past the cap.
+ */
+struct WavetableBuildCache
+{
+    static fs::path directory()
+    {
+        return fs::path{rack::asset::user("SurgeXTRack/WavetableCache")};
+    }
+
+    static constexpr uint64_t maxCacheBytes{256 * 1024 * 1024};
+
+    // Loader thread, after a normal build into osc
+    static void save(const fs::path &src, int frameSize, OscillatorStorage *osc)
+    {
+        auto &wt = osc->wt;
+        if (!wt.everBuilt || wt.n_tables == 0)
+            return;
+
+        fs::path entry;
+        if (!identify(src, frameSize, entry))
+            return;
+
+        header_t h;
+        memcpy(h.tag, entryTag, sizeof(h.tag));
+        h.dataSizes = wt.dataSizes;
+        h.size = wt.size;
+        h.n_tables = wt.n_tables;
+        h.size_po2 = wt.size_po2;
+        h.flags = wt.flags;
+        h.dt = wt.dt;
+        h.nameLength = osc->wavetable_display_name.size();
+
+        std::vector<int32_t> f32Off(nPointers), i16Off(nPointers);
+        int32_t f32Max{0}, i16Max{0};
+        auto *fp = &wt.TableF32WeakPointers[0][0];
+        auto *ip = &wt.TableI16WeakPointers[0][0];
+        for (size_t i = 0; i < nPointers; ++i)
+        {
+            f32Off[i] = fp[i] ? (int32_t)(fp[i] - wt.TableF32Data) : -1;
+            i16Off[i] = ip[i] ? (int32_t)(ip[i] - wt.TableI16Data) : -1;
+            f32Max = std::max(f32Max, f32Off[i]);
+            i16Max = std::max(i16Max, i16Off[i]);
+        }
+        // No table runs past its offset by more than a frame and its interpolation pad
+        auto extent = [&wt](int32_t m) {
+            return std::min((uint64_t)wt.dataSizes, (uint64_t)(m + wt.size + 2 * FIRipol_N));
+        };
+        h.f32Count = extent(f32Max);
+        h.i16Count = extent(i16Max);
+
+        std::vector<uint8_t> res;
+        auto append = [&res](const void *d, size_t n) {
+            auto *c = (const uint8_t *)d;
+            res.insert(res.end(), c, c + n);
+        };
+        append(&h, sizeof(h));
+        append(osc->wavetable_display_name.data(), h.nameLength);
+        append(f32Off.data(), nPointers * sizeof(int32_t));
+        append(i16Off.data(), nPointers * sizeof(int32_t));
+        append(wt.TableF32Data, h.f32Count * sizeof(float));
+        append(wt.TableI16Data, h.i16Count * sizeof(short));
+
+        try
+        {
+            fs::create_directories(directory());
+            // Several VCOs may cache the same table at once so write privately then move
+            auto tmp = entry;
+            auto tid = std::hash<std::thread::id>{}(std::this_thread::get_id());
+            tmp += "." + std::to_string(tid);
+            rack::system::writeFile(tmp.u8string(), res);
+            fs::rename(tmp, entry);
+            evict();
+        }
+        catch (const std::exception &e)
+        {
+            WARN("Unable to write wavetable cache entry %s: %s", entry.u8string().c_str(),
+                 e.what());
+        }
+    }
+
+    /*
+     * Loader thread. Returns true if osc now holds the table from src exactly as a normal
+     * load would have built it, and false (leaving osc untouched) otherwise.
+     */
+    static bool restore(const fs::path &src, int frameSize, int id, SurgeStorage *storage,
+                        OscillatorStorage *osc)
+    {
+        fs::path entry;
+        if (!identify(src, frameSize, entry))
+            return false;
+
+        std::vector<uint8_t> d;
+        try
+        {
+            if (!fs::exists(entry))
+                return false;
+            d = rack::system::readFile(entry.u8string());
+        }
+        catch (const std::exception &e)
+        {
+            WARN("Unable to read wavetable cache entry %s: %s", entry.u8string().c_str(),
+                 e.what());
+            return false;
+        }
+
+        header_t h;
+        if (d.size() < sizeof(h))
+            return false;
+        memcpy(&h, d.data(), sizeof(h));
+        auto expected = sizeof(h) + h.nameLength + 2 * nPointers * sizeof(int32_t) +
+                        h.f32Count * sizeof(float) + h.i16Count * sizeof(short);
+        if (memcmp(h.tag, entryTag, sizeof(h.tag)) != 0 || d.size() != expected)
+            return false;
+
+        if (h.f32Count > h.dataSizes || h.i16Count > h.dataSizes)
+            return false;
+
+        auto &wt = osc->wt;
+        auto *c = d.data() + sizeof(h);
+        std::string name((const char *)c, h.nameLength);
+        c += h.nameLength;
+        auto *f32Off = (const int32_t *)c;
+        c += nPointers * sizeof(int32_t);
+        auto *i16Off = (const int32_t *)c;
+        c += nPointers * sizeof(int32_t);
+
+        auto &wtMutex = storage->waveTableDataMutex;
+        std::lock_guard<std::remove_reference_t<decltype(wtMutex)>> g(wtMutex);
+        // Allocate the slot as the original build did, so even a never built slot restores
+        if (wt.dataSizes < h.dataSizes)
+            wt.allocPointers(h.dataSizes);
+        memcpy(wt.TableF32Data, c, h.f32Count * sizeof(float));
+        c += h.f32Count * sizeof(float);
+        memcpy(wt.TableI16Data, c, h.i16Count * sizeof(short));
+
+        auto *fp = &wt.TableF32WeakPointers[0][0];
+        auto *ip = &wt.TableI16WeakPointers[0][0];
+        for (size_t i = 0; i < nPointers; ++i)
+        {
+            fp[i] = f32Off[i] >= 0 ? wt.TableF32Data + f32Off[i] : nullptr;
+            ip[i] = i16Off[i] >= 0 ? wt.TableI16Data + i16Off[i] : nullptr;
+        }
+        wt.size = h.size;
+        wt.n_tables = h.n_tables;
+        wt.size_po2 = h.size_po2;
+        wt.flags = h.flags;
+        wt.dt = h.dt;
+        wt.everBuilt = true;
+        wt.refresh_display = true;
+        wt.current_id = id;
+        wt.queue_id = -1;
+        wt.queue_filename = "";
+        osc->wavetable_display_name = name;
+
+        try
+        {
+            fs::last_write_time(entry, fs::file_time_type::clock::now());
+        }
+        catch (const std::exception &)
+        {
+        }
+        return true;
+    }
+
+  private:
+    static constexpr char entryTag[8]{'S', 'X', 'T', 'W', 'T', 'B', 'C', '3'};
+    static constexpr size_t nPointers{sizeof(Wavetable::TableF32WeakPointers) /
+                                      sizeof(Wavetable::TableF32WeakPointers[0][0])};
+
+    struct header_t
+    {
+        char tag[8];
+        int32_t size, n_tables, size_po2, flags;
+        float dt;
+        uint32_t nameLength;
+        uint64_t dataSizes, f32Count, i16Count;
+    };
+
+    // Finds the entry name for this source's path, contents and frame size
+    static bool identify(const fs::path &src, int frameSize, fs::path &entry)
+    {
+        std::string content;
+        if (!contentHash(src, content))
+            return false;
+
+        auto key = src.u8string() + "|" + content + "|" + std::to_string(frameSize);
+        entry = directory() /
+                (WavetableStore::sha256((const uint8_t *)key.data(), key.size()) + ".wtc");
+        return true;
+    }
+
+    // SHA-256 of the source, rehashed only when its mtime or size differ from last time
+    static bool contentHash(const fs::path &src, std::string &res)
+    {
+        std::string stat;
+        try
+        {
+            if (!fs::is_regular_file(src))
+                return false;
+            auto mtime = fs::last_write_time(src).time_since_epoch().count();
+            stat = std::to_string(mtime) + "|" + std::to_string(fs::file_size(src));
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+
+        auto key = src.u8string();
+        {
+            std::lock_guard<std::mutex> g(hashMutex());
+            auto it = hashMap().find(key);
+            if (it != hashMap().end() && it->second.first == stat)
+            {
+                res = it->second.second;
+                return true;
+            }
+        }
+
+        std::vector<uint8_t> d;
+        try
+        {
+            d = rack::system::readFile(key);
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+        res = WavetableStore::sha256(d.data(), d.size());
+
+        std::lock_guard<std::mutex> g(hashMutex());
+        hashMap()[key] = {stat, res};
+        return true;
+    }
+
+    static std::mutex &hashMutex()
+    {
+        static std::mutex m;
+        return m;
+    }
+    // source path to (mtime and size, content hash)
+    static std::unordered_map<std::string, std::pair<std::string, std::string>> &hashMap()
+    {
+        static std::unordered_map<std::string, std::pair<std::string, std::string>> c;
+        return c;
+    }
+
+    // Removes the least recently used entries until the directory fits in maxCacheBytes
+    static void evict()
+    {
+        struct item_t
+        {
+            fs::path path;
+            fs::file_time_type used;
+            uint64_t size;
+        };
+        std::vector<item_t> items;
+        uint64_t total{0};
+        for (const auto &e : fs::directory_iterator(directory()))
+        {
+            if (e.path().extension() != ".wtc" || !fs::is_regular_file(e.path()))
+                continue;
+            items.push_back({e.path(), fs::last_write_time(e.path()), fs::file_size(e.path())});
+            total += items.back().size;
+        }
+        if (total <= maxCacheBytes)
+            return;
+
+        std::sort(items.begin(), items.end(),
+                  [](const auto &a, const auto &b) { return a.used < b.used; });
+        for (const auto &i : items)
+        {
+            if (total <= maxCacheBytes)
+                break;
+            std::error_code ec;
+            if (fs::remove(i.path, ec))
+                total -= i.size;
+        }
+    }
+};
+} // namespace sst::surgext_rack::vco
+#endif
@@ -0,0 +1,316 @@
+/*
+ * SurgeXT for VCV Rack - a Surge Synth Team product
+ *
+ * A set of modules expressing Surge XT into the VCV Rack Module Ecosystem
+ *
+ * Copyright 2019 - 2024, Various authors, as described in the github
+ * transaction log.
+ *
+ * Surge XT for VCV Rack is released under the GNU General Public License
+ * 3.0 or later (GPL-3.0-or-later). A copy of the license is in this
+ * repository in the file "LICENSE" or at:
+ *
+ * or at https://www.gnu.org/licenses/gpl-3.0.en.html
+ *
+ * All source for Surge XT for VCV Rack is available at
+ * https://github.com/surge-synthesizer/surge-rack/
+ */
+
+#ifndef SURGE_XT_RACK_SRC_WAVETABLESTORE_H
+#define SURGE_XT_RACK_SRC_WAVETABLESTORE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "SurgeStorage.h"
+#include "rack.hpp"
+#include "filesystem/import.h"
+
+namespace sst::surgext_rack::vco
+{
+/*
+ * A content addressed store for the streamed form of a wavetable (a wt_header followed
+ * by the int16 tables). Rather than embedding the base64 table in every patch a VCO can
+ * write it once to SurgeXTRack/WavetableStore/<digest>.wtd and save only the digest.
+ *
+ * Blobs are also held in a process wide digest to blob cache, so twenty VCOs on the same
+ * table share one buffer and a patch load reads and decodes each distinct table once.
+ * Likewise built tables are held by digest so a restore builds each distinct table once
+ * and every VCO using it aliases the one copy. Both caches hold weak references; an entry
+ * lives as long as some module holds it.
+ */
+struct WavetableStore
+{
+    typedef std::vector<uint8_t> blob_t;
+    typedef std::shared_ptr<const blob_t> blobPtr_t;
+    typedef std::shared_ptr<const Wavetable> tablePtr_t;
+
+    static fs::path directory()
+    {
+        return fs::path{rack::asset::user("SurgeXTRack/WavetableStore")};
+    }
+
+    // SHA-256 as lowercase hex. The store names files by it, so it has to resist collisions
+    static std::string sha256(const uint8_t *d, size_t n)
+    {
+        static constexpr uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4,
+            0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe,
+            0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f,
+            0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+            0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+            0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+            0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116,
+            0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7,
+            0xc67178f2};
+        uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                         0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+
+        auto rotr = [](uint32_t x, int r) { return (x >> r) | (x << (32 - r)); };
+        auto compress = [&](const uint8_t *blk) {
+            uint32_t w[64];
+            for (int i = 0; i < 16; ++i)
+                w[i] = (uint32_t)blk[4 * i] << 24 | (uint32_t)blk[4 * i + 1] << 16 |
+                       (uint32_t)blk[4 * i + 2] << 8 | (uint32_t)blk[4 * i + 3];
+            for (int i = 16; i < 64; ++i)
+            {
+                auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+                auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+                w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+            }
+
+            uint32_t v[8];
+            memcpy(v, h, sizeof(v));
+            for (int i = 0; i < 64; ++i)
+            {
+                auto S1 = rotr(v[4], 6) ^ rotr(v[4], 11) ^ rotr(v[4], 25);
+                auto ch = (v[4] & v[5]) ^ (~v[4] & v[6]);
+                auto t1 = v[7] + S1 + ch + k[i] + w[i];
+                auto S0 = rotr(v[0], 2) ^ rotr(v[0], 13) ^ rotr(v[0], 22);
+                auto maj = (v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]);
+                memmove(v + 1, v, 7 * sizeof(uint32_t));
+                v[4] += t1;
+                v[0] = t1 + S0 + maj;
+            }
+            for (int i = 0; i < 8; ++i)
+                h[i] += v[i];
+        };
+
+        auto full = n / 64;
+        for (size_t i = 0; i < full; ++i)
+            compress(d + 64 * i);
+
+        // pad with a one bit, zeros and the bit length, spilling into a second block if needed
+        uint8_t tail[128]{};
+        auto rem = n - full * 64;
+        if (rem)
+            memcpy(tail, d + full * 64, rem);
+        tail[rem] = 0x80;
+        auto tl = (rem + 9 <= 64) ? 64 : 128;
+        uint64_t bits = (uint64_t)n * 8;
+        for (int i = 0; i < 8; ++i)
+            tail[tl - 1 - i] = (uint8_t)(bits >> (8 * i));
+        compress(tail);
+        if (tl == 128)
+            compress(tail + 64);
+
+        char res[65];
+        for (int i = 0; i < 8; ++i)
+            snprintf(res + 8 * i, 9, "%08x", h[i]);
+        return std::string(res, 64);
+    }
+
+    // Tagged with the length so a digest also pins the blob size
+    static std::string digestFor(const blob_t &b)
+    {
+        return sha256(b.data(), b.size()) + "-" + std::to_string(b.size());
+    }
+
+    /*
+     * Digests come back out of patch files and name a file on disk, so only accept exactly
+     * what digestFor writes: 64 lowercase hex digits, a dash and a plain decimal size.
+     */
+    static bool isValidDigest(const std::string &d)
+    {
+        if (d.size() < 66 || d.size() > 86 || d[64] != '-')
+            return false;
+        for (size_t i = 0; i < 64; ++i)
+        {
+            if (!((d[i] >= '0' && d[i] <= '9') || (d[i] >= 'a' && d[i] <= 'f')))
+                return false;
+        }
+        if (d[65] == '0' && d.size() > 66)
+            return false;
+        for (size_t i = 65; i < d.size(); ++i)
+        {
+            if (d[i] < '0' || d[i] > '9')
+                return false;
+        }
+        return true;
+    }
+
+    /*
+     * Registers the blob in the cache, writing the sidecar unless an identical one is on
+     * disk already, and returns the digest. The returned pointer is the shared copy to hold
+     * on to.
+     */
+    static blobPtr_t store(const blob_t &b, std::string &digest)
+    {
+        digest = digestFor(b);
+
+        std::lock_guard<std::mutex> g(cacheMutex());
+        auto &cache = cacheMap();
+        auto it = cache.find(digest);
+        blobPtr_t res = (it != cache.end()) ? it->second.lock() : nullptr;
+        if (!res)
+        {
+            res = std::make_shared<const blob_t>(b);
+            cache[digest] = res;
+        }
+
+        auto p = pathFor(digest);
+        try
+        {
+            if (!matchesFile(p, *res))
+            {
+                fs::create_directories(directory());
+                auto tmp = p;
+                tmp += ".tmp";
+                rack::system::writeFile(tmp.u8string(), *res);
+                fs::rename(tmp, p);
+            }
+        }
+        catch (const std::exception &e)
+        {
+            WARN("Unable to write wavetable store entry %s: %s", digest.c_str(), e.what());
+            digest = {};
+        }
+        return res;
+    }
+
+    // Returns nullptr if the digest is malformed, neither cached nor on disk, or damaged
+    static blobPtr_t fetch(const std::string &digest)
+    {
+        if (!isValidDigest(digest))
+        {
+            WARN("Ignoring malformed wavetable store digest '%s'", digest.c_str());
+            return nullptr;
+        }
+
+        std::lock_guard<std::mutex> g(cacheMutex());
+        auto &cache = cacheMap();
+        auto it = cache.find(digest);
+        if (it != cache.end())
+        {
+            if (auto res = it->second.lock())
+                return res;
+        }
+
+        blob_t b;
+        try
+        {
+            auto p = pathFor(digest);
+            if (!fs::exists(p))
+                return nullptr;
+            b = rack::system::readFile(p.u8string());
+        }
+        catch (const std::exception &e)
+        {
+            WARN("Unable to read wavetable store entry %s: %s", digest.c_str(), e.what());
+            return nullptr;
+        }
+
+        if (digestFor(b) != digest)
+        {
+            WARN("Wavetable store entry %s does not match its digest", digest.c_str());
+            return nullptr;
+        }
+
+        auto res = std::make_shared<const blob_t>(std::move(b));
+        cache[digest] = res;
+
+        // drop entries which nothing holds any more while we have the lock
+        for (auto c = cache.begin(); c != cache.end();)
+        {
+            if (c->second.expired())
+                c = cache.erase(c);
+            else
+                ++c;
+        }
+        return res;
+    }
+
+    // Returns the table built from this blob, building it if no module holds it already
+    static tablePtr_t build(const std::string &digest, const blob_t &b)
+    {
+        std::lock_guard<std::mutex> g(tableMutex());
+        auto &cache = tableMap();
+        auto it = cache.find(digest);
+        if (it != cache.end())
+        {
+            if (auto res = it->second.lock())
+                return res;
+        }
+
+        if (b.size() < sizeof(wt_header))
+            return nullptr;
+        wt_header wth;
+        memcpy(&wth, b.data(), sizeof(wt_header));
+        auto res = std::make_shared<Wavetable>();
+        if (!res->BuildWT((void *)(b.data() + sizeof(wt_header)), wth, false))
+            return nullptr;
+
+        cache[digest] = res;
+        for (auto c = cache.begin(); c != cache.end();)
+        {
+            if (c->second.expired())
+                c = cache.erase(c);
+            else
+                ++c;
+        }
+        return res;
+    }
+
+  private:
+    // A damaged or partial sidecar is rewritten rather than trusted
+    static bool matchesFile(const fs::path &p, const blob_t &b)
+    {
+        if (!fs::exists(p) || fs::file_size(p) != b.size())
+            return false;
+        auto onDisk = rack::system::readFile(p.u8string());
+        return onDisk.size() == b.size() && memcmp(onDisk.data(), b.data(), b.size()) == 0;
+    }
+
+    static fs::path pathFor(const std::string &digest) { return directory() / (digest + ".wtd"); }
+
+    static std::mutex &cacheMutex()
+    {
+        static std::mutex m;
+        return m;
+    }
+    static std::unordered_map<std::string, std::weak_ptr<const blob_t>> &cacheMap()
+    {
+        static std::unordered_map<std::string, std::weak_ptr<const blob_t>> c;
+        return c;
+    }
+
+    static std::mutex &tableMutex()
+    {
+        static std::mutex m;
+        return m;
+    }
+    static std::unordered_map<std::string, std::weak_ptr<const Wavetable>> &tableMap()
+    {
+        static std::unordered_map<std::string, std::weak_ptr<const Wavetable>> c;
+        return c;
+    }
+};
+} // namespace sst::surgext_rack::vco
+#endif
@@ -17,6 +17,176 @@
  */
 
 #include "XTModule.h"
+#include "dsp/Effect.h"
+#include "dsp/Oscillator.h"
 
 std::mutex sst::surgext_rack::modules::XTModule::xtSurgeCreateMutex{};
 std::atomic<bool> sst::surgext_rack::modules::XTModule::showedPathsOnce{false};
+
+namespace sst::surgext_rack::modules
+{
+struct SharedStorageErrorListener : public SurgeStorage::ErrorListener
+{
+    void onSurgeError(const std::string &msg, const std::string &title,
+                      const SurgeStorage::ErrorType &t) override
+    {
+        WARN("Surge Reported an Error on the Shared Storage");
+        WARN("%s", title.c_str());
+        WARN("%s", msg.c_str());
+    }
+};
+
+std::shared_ptr<SurgeStorage> XTModule::acquireSharedReadOnlyStorage()
+{
+    static std::mutex sharedStorageMutex;
+    static std::weak_ptr<SurgeStorage> sharedStorage;
+    static SharedStorageErrorListener sharedErrorListener;
+
+    std::lock_guard<std::mutex> lg(sharedStorageMutex);
+    auto res = sharedStorage.lock();
+    if (!res)
+    {
+        res = std::make_shared<SurgeStorage>(makeStorageConfig(false, false));
+        res->addErrorListener(&sharedErrorListener);
+        initializeStoragePatch(res.get());
+
+        res->setSamplerate(APP->engine->getSampleRate());
+        res->init_tables();
+        sharedStorage = res;
+    }
+    return res;
+}
+
+void XTModule::initializeSurgeGlobals()
+{
+    static std::once_flag once;
+    std::call_once(once, []() {
+        std::lock_guard<std::mutex> lgxt(xtSurgeCreateMutex);
+        auto s = std::make_unique<SurgeStorage>(makeStorageConfig(false, false));
+        initializeStoragePatch(s.get());
+        s->setSamplerate(48000);
+        s->init_tables();
+
+        auto &patch = s->getPatch();
+        auto *osc = &patch.scene[0].osc[0];
+        alignas(16) unsigned char oscbuffer[oscillator_buffer_size];
+        for (int t = 0; t < n_osc_types; ++t)
+        {
+            osc->type.val.i = t;
+            auto *o = spawn_osc(t, s.get(), osc, patch.scenedata[0], oscbuffer);
+            if (!o)
+                continue;
+            o->init_ctrltypes();
+            o->init_default_values();
+            o->init_extra_config();
+            // the wavetable oscillators can't init without a table loaded
+            if (t != ot_wavetable && t != ot_window)
+                o->init(72.0);
+            o->~Oscillator();
+        }
+
+        auto *fx = &patch.fx[0];
+        for (int t = 1; t < n_fx_types; ++t)
+        {
+            fx->type.val.i = t;
+            std::unique_ptr<Effect> e(spawn_effect(t, s.get(), fx, patch.globaldata));
+            if (!e)
+                continue;
+            e->init();
+            e->init_ctrltypes();
+            e->init_default_values();
+        }
+    });
+}
+
+struct WavetableCatalog
+{
+    std::vector<Patch> wt_list;
+    std::vector<PatchCategory> wt_category;
+    std::vector<int> wtOrdering, wtCategoryOrdering;
+    int firstThirdPartyWTCategory{0}, firstUserWTCategory{0};
+
+    void captureFrom(SurgeStorage *s)
+    {
+        wt_list = s->wt_list;
+        wt_category = s->wt_category;
+        wtOrdering = s->wtOrdering;
+        wtCategoryOrdering = s->wtCategoryOrdering;
+        firstThirdPartyWTCategory = s->firstThirdPartyWTCategory;
+        firstUserWTCategory = s->firstUserWTCategory;
+    }
+
+    void applyTo(SurgeStorage *s) const
+    {
+        s->wt_list = wt_list;
+        s->wt_category = wt_category;
+        s->wtOrdering = wtOrdering;
+        s->wtCategoryOrdering = wtCategoryOrdering;
+        s->firstThirdPartyWTCategory = firstThirdPartyWTCategory;
+        s->firstUserWTCategory = firstUserWTCategory;
+    }
+};
+
+static std::mutex wavetableCatalogMutex;
+static WavetableCatalog wavetableCatalog;
+static std::atomic<uint64_t> wavetableCatalogGen{0};
+
+uint64_t XTModule::applyWavetableCatalog(SurgeStorage *s)
+{
+    std::lock_guard<std::mutex> lg(wavetableCatalogMutex);
+    if (wavetableCatalogGen == 0)
+    {
+        s->refresh_wtlist();
+        wavetableCatalog.captureFrom(s);
+        wavetableCatalogGen = 1;
+    }
+    else
+    {
+        wavetableCatalog.applyTo(s);
+    }
+    return wavetableCatalogGen;
+}
+
+uint64_t XTModule::refreshWavetableCatalog(SurgeStorage *s)
+{
+    std::lock_guard<std::mutex> lg(wavetableCatalogMutex);
+    s->refresh_wtlist();
+    wavetableCatalog.captureFrom(s);
+    wavetableCatalogGen++;
+    return wavetableCatalogGen;
+}
+
+uint64_t XTModule::wavetableCatalogGeneration() { return wavetableCatalogGen; }
+
+static std::mutex userFXPresetMutex;
+static bool userFXPresetsScanned{false}, userFXPresetsForceRescan{false};
+static std::array<std::vector<Surge::Storage::FxUserPreset::Preset>, n_fx_types> userFXPresets;
+
+std::vector<Surge::Storage::FxUserPreset::Preset>
+XTModule::userFXPresetsForType(SurgeStorage *s, int fxType)
+{
+    std::lock_guard<std::mutex> lg(userFXPresetMutex);
+    if (!userFXPresetsScanned)
+    {
+        if (userFXPresetsForceRescan)
+            s->fxUserPreset->doPresetRescan(s, true);
+        userFXPresetsForceRescan = false;
+
+        // The first call scans the user preset directory on this storage; grab every
+        // type at once so no other storage needs to scan
+        for (int t = 0; t < n_fx_types; ++t)
+            userFXPresets[t] = s->fxUserPreset->getPresetsForSingleType(t);
+        userFXPresetsScanned = true;
+    }
+    if (fxType < 0 || fxType >= n_fx_types)
+        return {};
+    return userFXPresets[fxType];
+}
+
+void XTModule::invalidateUserFXPresets()
+{
+    std::lock_guard<std::mutex> lg(userFXPresetMutex);
+    userFXPresetsScanned = false;
+    userFXPresetsForceRescan = true;
+}
+} // namespace sst::surgext_rack::modules
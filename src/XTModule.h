@@ -26,6 +26,7 @@
 
 #include "SurgeXT.h"
 #include "SurgeStorage.h"
+#include "FxPresetAndClipboardManager.h"
 #include "rack.hpp"
 #include "XTStyle.h"
 
@@ -49,7 +50,24 @@ struct XTModule : public rack::Module, public SurgeStorage::ErrorListener
 {
     static std::mutex xtSurgeCreateMutex;
 
-    XTModule() : rack::Module() { storage.reset(nullptr); }
+    /*
+     * Surge sets up some process wide state lazily, and not thread safely, the first time
+     * a storage is made or a given oscillator or effect type is spawned. That is the
+     * statics behind the first SurgeStorage's tables, the statics each oscillator type
+     * primes in init and init_ctrltypes, and those each effect type primes in init (such
+     * as the Airwindows registry). initializeSurgeGlobals primes all of them once, under
+     * xtSurgeCreateMutex, when the first module is constructed, so a Rack launch which
+     * builds no Surge module pays nothing. Everything process wide of ours (the shared
+     * read only storage, the wavetable catalog, the user FX presets and the preset tables)
+     * has a lock of its own, so constructors don't hold the mutex otherwise.
+     */
+    static void initializeSurgeGlobals();
+
+    XTModule() : rack::Module()
+    {
+        initializeSurgeGlobals();
+        storage.reset();
+    }
 
     std::string getBuildInfo()
     {
@@ -81,8 +99,13 @@ struct XTModule : public rack::Module, public SurgeStorage::ErrorListener
         float sr = APP->engine->getSampleRate();
         if (storage)
         {
-            storage->setSamplerate(sr);
-            storage->init_tables();
+            // Rack runs a single engine rate, so the shared storage moves with the first
+            // module to see a change and every other holder finds it already updated
+            if (!usesSharedStorage || storage->samplerate != sr)
+            {
+                storage->setSamplerate(sr);
+                storage->init_tables();
+            }
             updateBPMFromClockCV(lastClockCV, storage->samplerate_inv, sr, true);
             moduleSpecificSampleRateChange();
         }
@@ -92,12 +115,12 @@ struct XTModule : public rack::Module, public SurgeStorage::ErrorListener
 
     static std::atomic<bool> showedPathsOnce;
 
-    fs::path getRackUserWavetablesDir()
+    static fs::path getRackUserWavetablesDir()
     {
         return fs::path{rack::asset::user("SurgeXTRack/UserWavetables")};
     }
 
-    void guaranteeRackUserWavetablesDir()
+    static void guaranteeRackUserWavetablesDir()
     {
         auto p = getRackUserWavetablesDir();
         try
@@ -113,7 +136,7 @@ struct XTModule : public rack::Module, public SurgeStorage::ErrorListener
         }
     }
 
-    void setupSurgeCommon(int NUM_PARAMS, bool loadWavetables, bool loadFX)
+    static SurgeStorage::SurgeStorageConfig makeStorageConfig(bool loadWavetables, bool loadFX)
     {
         SurgeStorage::SurgeStorageConfig config;
         config.suppliedDataPath = SurgeStorage::skipPatchLoadDataPathSentinel;
@@ -126,20 +149,75 @@ struct XTModule : public rack::Module, public SurgeStorage::ErrorListener
                 fs::path{rack::asset::user("SurgeXTRack/SurgeXTRack_ExtraContent")};
             guaranteeRackUserWavetablesDir();
             config.extraUsersWavetablesPath = getRackUserWavetablesDir();
-            config.scanWavetableAndPatches = loadWavetables;
+            // The wavetable catalog is scanned once per process by applyWavetableCatalog
+            config.scanWavetableAndPatches = false;
         }
+        return config;
+    }
+
+    static void initializeStoragePatch(SurgeStorage *s)
+    {
+        s->getPatch().init_default_values();
+        s->getPatch().copy_globaldata(s->getPatch().globaldata);
+        s->getPatch().copy_scenedata(s->getPatch().scenedata[0], 0);
+        s->getPatch().copy_scenedata(s->getPatch().scenedata[1], 1);
+    }
+
+    void setupSurgeCommon(int NUM_PARAMS, bool loadWavetables, bool loadFX)
+    {
+        auto config = makeStorageConfig(loadWavetables, loadFX);
 
         showBuildInfo();
         storage = std::make_unique<SurgeStorage>(config);
         storage->addErrorListener(this);
-        storage->getPatch().init_default_values();
-        storage->getPatch().copy_globaldata(storage->getPatch().globaldata);
-        storage->getPatch().copy_scenedata(storage->getPatch().scenedata[0], 0);
-        storage->getPatch().copy_scenedata(storage->getPatch().scenedata[1], 1);
+        initializeStoragePatch(storage.get());
+        if (loadWavetables)
+            appliedWavetableCatalogGeneration = applyWavetableCatalog(storage.get());
 
         onSampleRateChange();
     }
 
+    /*
+     * Modules which only read from their storage (the pitch, dB and sinc tables, the
+     * sample rate) and never write the patch, scenedata or temposync ratio don't need
+     * a SurgeStorage of their own. They can use this instead of setupSurgeCommon and
+     * hold a reference to a single process-wide storage which lives as long as any
+     * module uses it.
+     */
+    void setupSurgeSharedReadOnly(int NUM_PARAMS)
+    {
+        showBuildInfo();
+        storage = acquireSharedReadOnlyStorage();
+        usesSharedStorage = true;
+
+        onSampleRateChange();
+    }
+    static std::shared_ptr<SurgeStorage> acquireSharedReadOnlyStorage();
+
+    /*
+     * Scanning the factory, third party and user wavetable directories and the user FX
+     * presets is slow, and used to happen in every constructor while holding the create
+     * mutex. Instead we scan once per process into a catalog and copy that catalog into
+     * each storage which needs it. refreshWavetableCatalog rescans explicitly (for instance
+     * after a content download) and bumps the generation so other modules can resync with
+     * syncWavetableCatalog from the UI thread. Both return the catalog generation applied.
+     */
+    static uint64_t applyWavetableCatalog(SurgeStorage *s);
+    static uint64_t refreshWavetableCatalog(SurgeStorage *s);
+    static uint64_t wavetableCatalogGeneration();
+    uint64_t appliedWavetableCatalogGeneration{0};
+    bool syncWavetableCatalog()
+    {
+        if (!storage || wavetableCatalogGeneration() == appliedWavetableCatalogGeneration)
+            return false;
+        appliedWavetableCatalogGeneration = applyWavetableCatalog(storage.get());
+        return true;
+    }
+
+    static std::vector<Surge::Storage::FxUserPreset::Preset> userFXPresetsForType(SurgeStorage *s,
+                                                                                 int fxType);
+    static void invalidateUserFXPresets();
+
     float lastBPM = -1, lastClockCV = -100;
     float dPhase = 0;
     inline bool updateBPMFromClockCV(float clockCV, float sampleTime, float sampleRate,
@@ -161,7 +239,7 @@ struct XTModule : public rack::Module, public SurgeStorage::ErrorListener
 
         lastBPM = beatsPerMinute;
 
-        if (storage.get())
+        if (storage.get() && !usesSharedStorage)
         {
             // FIX ME new API
             storage->temposyncratio = beatsPerMinute / 120.0;
@@ -213,7 +291,8 @@ struct XTModule : public rack::Module, public SurgeStorage::ErrorListener
     virtual Parameter *surgeDisplayParameterForParamId(int paramId) { return nullptr; }
     virtual Parameter *surgeDisplayParameterForModulatorParamId(int paramId) { return nullptr; }
 
-    std::unique_ptr<SurgeStorage> storage;
+    std::shared_ptr<SurgeStorage> storage;
+    bool usesSharedStorage{false};
     int storage_id_start, storage_id_end;
 
     json_t *makeCommonDataJson()
@@ -258,10 +337,26 @@ struct XTModule : public rack::Module, public SurgeStorage::ErrorListener
     virtual json_t *makeModuleSpecificJson() { return nullptr; }
     virtual void readModuleSpecificJson(json_t *modJ) {}
 
+    /*
+     * Modules with a menu option to apply mod inputs every sample set
+     * offersAudioRateModulation in their constructor. New instances start with it off, but
+     * patches saved before the option existed modulated at audio rate, so a patch without
+     * the key loads with it on. It is stored in the modulespecific block.
+     */
+    bool offersAudioRateModulation{false};
+    std::atomic<bool> audioRateModulation{false};
+
     virtual json_t *dataToJson() override
     {
         json_t *commonJ = makeCommonDataJson();
         json_t *moduleSpecificJ = makeModuleSpecificJson();
+        if (offersAudioRateModulation)
+        {
+            if (!moduleSpecificJ)
+                moduleSpecificJ = json_object();
+            json_object_set_new(moduleSpecificJ, "audioRateModulation",
+                                json_boolean(audioRateModulation));
+        }
 
         json_t *rootJ = json_object();
         if (commonJ)
@@ -282,10 +377,65 @@ struct XTModule : public rack::Module, public SurgeStorage::ErrorListener
         auto specificJ = json_object_get(rootJ, "modulespecific");
         if (commonJ)
             readCommonDataJson(commonJ);
+        if (offersAudioRateModulation)
+        {
+            auto arm = specificJ ? json_object_get(specificJ, "audioRateModulation") : nullptr;
+            audioRateModulation = arm ? json_boolean_value(arm) : true;
+        }
         if (specificJ)
             readModuleSpecificJson(specificJ);
     }
 
+    /*
+     * routingEdits counts edits to the knobs and cables. Every knob made with configParam
+     * bumps it when its quantity is set, reset, randomised or loaded, and every cable
+     * change bumps it too, so ModulationAssistant::setupMatrix can skip reading all the
+     * depth knobs on blocks where nothing moved.
+     */
+    std::atomic<uint32_t> routingEdits{0};
+    void noteRoutingEdit() { routingEdits.fetch_add(1, std::memory_order_release); }
+
+    template <typename T> struct EditNotifyingQuantity : T
+    {
+        void setValue(float v) override
+        {
+            T::setValue(v);
+            notify();
+        }
+        void reset() override
+        {
+            T::reset();
+            notify();
+        }
+        void randomize() override
+        {
+            T::randomize();
+            notify();
+        }
+        void fromJson(json_t *rootJ) override
+        {
+            T::fromJson(rootJ);
+            notify();
+        }
+        void notify()
+        {
+            if (this->module)
+                static_cast<XTModule *>(this->module)->noteRoutingEdit();
+        }
+    };
+
+    // Hides rack::Module::configParam so every knob we configure reports its edits
+    template <typename T = rack::ParamQuantity, typename... Args> T *configParam(Args... args)
+    {
+        return rack::Module::configParam<EditNotifyingQuantity<T>>(args...);
+    }
+
+    void onPortChange(const PortChangeEvent &e) override
+    {
+        noteRoutingEdit();
+        rack::Module::onPortChange(e);
+    }
+
     template <typename T = rack::ParamQuantity, typename... Args> T *configParamNoRand(Args... args)
     {
         auto *res = configParam<T>(args...);
@@ -808,6 +958,31 @@ struct ModulationAssistant
     bool broadcast[nInputs];
     int chans{1};
     bool anyConnected{false};
+
+    /*
+     * The routing only changes on a cable or depth knob edit, so setupMatrix compares
+     * against what it saw last time and only rebuilds when something moved, bumping
+     * generation so callers can cache anything derived from it. The rebuild also keeps
+     * a sparse list of the connected inputs with a nonzero depth for each parameter,
+     * which is all updateValues and the ramps iterate.
+     */
+    uint32_t generation{0};
+    bool matrixDirty{true};
+
+    /*
+     * The depth knobs are only read back when the module's routingEdits count moved. A
+     * write straight to params[] from outside bypasses the quantity, so a full read still
+     * happens every backstopBlocks calls to catch those.
+     */
+    uint32_t seenRoutingEdits{0};
+    int blocksSinceScan{0};
+    static constexpr int backstopBlocks{256};
+    float muRaw[nPar][nInputs]{};
+    int nInputChannels[nInputs]{};
+    uint8_t routeStart[nPar + 1]{};
+    uint8_t routeInput[nPar * nInputs]{};
+    static_assert(nPar * nInputs < 256, "Routes are indexed with bytes");
+
     void initialize(M *m)
     {
         for (auto p = 0U; p < nPar; ++p)
@@ -816,41 +991,77 @@ struct ModulationAssistant
             f[p] = (pq->maxValue - pq->minValue);
             fInv[p] = 1.0 / f[p];
         }
+        matrixDirty = true;
         setupMatrix(m);
     }
 
     void setupMatrix(M *m)
     {
-        chans = std::max(1, m->polyChannelCount());
+        auto nc = std::max(1, m->polyChannelCount());
+        bool dirty = matrixDirty || nc != chans;
+        chans = nc;
 
-        anyConnected = false;
         for (auto i = 0U; i < nInputs; ++i)
         {
-            connected[i] = m->inputs[i + input0].isConnected();
-            anyConnected = anyConnected || connected[i];
-            if (connected[i])
+            auto &inp = m->inputs[i + input0];
+            auto ch = inp.isConnected() ? inp.getChannels() : 0;
+            if (ch != nInputChannels[i])
             {
-                auto ch = m->inputs[i + input0].getChannels();
-                broadcast[i] = ch == 1 && chans != 1;
+                nInputChannels[i] = ch;
+                dirty = true;
             }
-            else
+        }
+
+        auto edits = m->routingEdits.load(std::memory_order_acquire);
+        if (dirty || edits != seenRoutingEdits || ++blocksSinceScan >= backstopBlocks)
+        {
+            seenRoutingEdits = edits;
+            blocksSinceScan = 0;
+            for (auto p = 0U; p < nPar; ++p)
             {
-                broadcast[i] = false; // to have a value at least
+                for (auto i = 0U; i < nInputs; ++i)
+                {
+                    auto v = m->params[m->modulatorIndexFor(p + par0, i)].getValue();
+                    if (v != muRaw[p][i])
+                    {
+                        muRaw[p][i] = v;
+                        dirty = true;
+                    }
+                }
             }
         }
 
+        if (!dirty)
+            return;
+
+        anyConnected = false;
+        for (auto i = 0U; i < nInputs; ++i)
+        {
+            connected[i] = nInputChannels[i] > 0;
+            anyConnected = anyConnected || connected[i];
+            // to have a value at least when disconnected
+            broadcast[i] = connected[i] && nInputChannels[i] == 1 && chans != 1;
+        }
+
+        uint8_t nRoutes{0};
         for (auto p = 0U; p < nPar; ++p)
         {
+            routeStart[p] = nRoutes;
             auto sm = 0.f;
             for (auto i = 0U; i < nInputs; ++i)
             {
-                auto idx = m->modulatorIndexFor(p + par0, i);
-                mu[p][i] = m->params[idx].getValue() * f[p];
+                mu[p][i] = muRaw[p][i] * f[p];
                 sm += fabs(mu[p][i]);
                 muSSE[p][i] = _mm_set1_ps(mu[p][i]);
+                if (connected[i] && mu[p][i] != 0.f)
+                    routeInput[nRoutes++] = i;
             }
             connectedParameter[p] = (sm > 1e-6f) && anyConnected;
         }
+        routeStart[nPar] = nRoutes;
+
+        matrixDirty = false;
+        generation++;
     }
 
     void updateValues(M *m)
@@ -867,12 +1078,10 @@ struct ModulationAssistant
             {
                 // Set up the base values
                 auto mv = 0.f;
-                if (connectedParameter[p])
+                for (auto r = routeStart[p]; r < routeStart[p + 1]; ++r)
                 {
-                    for (auto i = 0U; i < nInputs; ++i)
-                    {
-                        mv += mu[p][i] * inp[i];
-                    }
+                    auto i = routeInput[r];
+                    mv += mu[p][i] * inp[i];
                 }
                 modvalues[p][0] = mv;
                 basevalues[p] = m->params[p + par0].getValue();
@@ -884,82 +1093,165 @@ struct ModulationAssistant
         }
         else
         {
-            const auto r2scv = _mm_set1_ps(RACK_TO_SURGE_CV_MUL);
             int polyChans = (chans - 1) / 4 + 1;
             __m128 snapInputs[nInputs][MAX_POLY >> 2];
             for (auto i = 0U; i < nInputs; ++i)
             {
                 if (!connected[i])
+                    continue;
+
+                for (int c = 0; c < polyChans; ++c)
                 {
-                    for (int c = 0; c < polyChans; ++c)
-                    {
-                        snapInputs[i][c] = _mm_setzero_ps();
-                    }
-                }
-                else if (broadcast[i])
-                {
-                    auto iv = m->inputs[i + input0].getVoltage(0) * RACK_TO_SURGE_CV_MUL;
-                    for (int c = 0; c < polyChans; ++c)
-                    {
-                        snapInputs[i][c] = _mm_set1_ps(iv);
-                    }
-                }
-                else
-                {
-                    // This loop can SIMD-ize
-                    for (int c = 0; c < polyChans; ++c)
-                    {
-                        auto v = _mm_loadu_ps(m->inputs[i + input0].getVoltages(c * 4));
-                        v = _mm_mul_ps(v, r2scv);
-                        snapInputs[i][c] = v;
-                    }
+                    snapInputs[i][c] = inputSSE(m, i, c);
                 }
             }
             for (auto p = 0U; p < nPar; ++p)
             {
-                if (!connectedParameter[p])
-                {
-                    basevalues[p] = m->params[p + par0].getValue();
-                    auto v0 = _mm_set1_ps(basevalues[p]);
+                basevalues[p] = m->params[p + par0].getValue();
+                auto v0 = _mm_set1_ps(basevalues[p]);
 
+                if (routeStart[p] == routeStart[p + 1])
+                {
                     for (int c = 0; c < polyChans; ++c)
                     {
                         _mm_store_ps(&modvalues[p][c * 4], _mm_setzero_ps());
                         valuesSSE[p][c] = v0;
                         _mm_store_ps(&values[p][c * 4], valuesSSE[p][c]);
                     }
-
-                    animValues[p] = fInv[p] * modvalues[p][0];
                 }
                 else
                 {
                     __m128 mv[MAX_POLY >> 2];
                     memset(mv, 0, polyChans * sizeof(__m128));
 
-                    for (auto i = 0U; i < nInputs; ++i)
+                    for (auto r = routeStart[p]; r < routeStart[p + 1]; ++r)
                     {
-                        if (!connected[i])
-                            continue;
-
-                        // This is the loop we will simd-4 stride
+                        auto i = routeInput[r];
                         for (int c = 0; c < polyChans; ++c)
                         {
                             mv[c] = _mm_add_ps(mv[c], _mm_mul_ps(muSSE[p][i], snapInputs[i][c]));
                         }
                     }
 
-                    basevalues[p] = m->params[p + par0].getValue();
-                    auto v0 = _mm_set1_ps(basevalues[p]);
-
                     for (int c = 0; c < polyChans; ++c)
                     {
                         _mm_store_ps(&modvalues[p][c * 4], mv[c]);
                         valuesSSE[p][c] = _mm_add_ps(v0, mv[c]);
                         _mm_store_ps(&values[p][c * 4], valuesSSE[p][c]);
                     }
+                }
 
-                    animValues[p] = fInv[p] * modvalues[p][0];
+                animValues[p] = fInv[p] * modvalues[p][0];
+            }
+        }
+    }
+
+    /*
+     * Block rate evaluation with per sample ramps. Call updateRampTargets once a block
+     * after setupMatrix and stepRamp every sample, including the first of the block, and
+     * values glide to the block's target over the given number of samples. Inputs flagged
+     * in audioRate are left out of the ramp and added at full rate in stepRamp instead.
+     */
+    bool audioRate[nInputs]{};
+    __m128 rampSSE[nPar][MAX_POLY >> 2];
+    __m128 dRampSSE[nPar][MAX_POLY >> 2];
+    int rampPolyChans{-1};
+
+    inline __m128 inputSSE(M *m, uint32_t i, int c) const
+    {
+        if (broadcast[i])
+            return _mm_set1_ps(m->inputs[i + input0].getVoltage(0) * RACK_TO_SURGE_CV_MUL);
+        return _mm_mul_ps(_mm_loadu_ps(m->inputs[i + input0].getVoltages(c * 4)),
+                          _mm_set1_ps(RACK_TO_SURGE_CV_MUL));
+    }
+
+    void updateRampTargets(M *m, int samples)
+    {
+        int polyChans = (chans - 1) / 4 + 1;
+        // A change in width re-snaps rather than ramping lanes from stale values
+        bool snap = polyChans != rampPolyChans;
+        rampPolyChans = polyChans;
+
+        __m128 snapInputs[nInputs][MAX_POLY >> 2];
+        for (auto i = 0U; i < nInputs; ++i)
+        {
+            if (!connected[i] || audioRate[i])
+                continue;
+            for (int c = 0; c < polyChans; ++c)
+                snapInputs[i][c] = inputSSE(m, i, c);
+        }
+
+        const auto dt = _mm_set1_ps(1.f / samples);
+        for (auto p = 0U; p < nPar; ++p)
+        {
+            basevalues[p] = m->params[p + par0].getValue();
+            auto v0 = _mm_set1_ps(basevalues[p]);
+
+            __m128 target[MAX_POLY >> 2];
+            for (int c = 0; c < polyChans; ++c)
+                target[c] = v0;
+
+            for (auto r = routeStart[p]; r < routeStart[p + 1]; ++r)
+            {
+                auto i = routeInput[r];
+                if (audioRate[i])
+                    continue;
+                for (int c = 0; c < polyChans; ++c)
+                    target[c] = _mm_add_ps(target[c], _mm_mul_ps(muSSE[p][i], snapInputs[i][c]));
+            }
+
+            for (int c = 0; c < polyChans; ++c)
+            {
+                if (snap)
+                {
+                    rampSSE[p][c] = target[c];
+                    dRampSSE[p][c] = _mm_setzero_ps();
+                }
+                else
+                {
+                    dRampSSE[p][c] = _mm_mul_ps(_mm_sub_ps(target[c], rampSSE[p][c]), dt);
+                }
+            }
+
+            animValues[p] = fInv[p] * (_mm_cvtss_f32(target[0]) - basevalues[p]);
+        }
+    }
+
+    void stepRamp(M *m)
+    {
+        int polyChans = rampPolyChans;
+
+        bool anyAudioRate{false};
+        __m128 audioInputs[nInputs][MAX_POLY >> 2];
+        for (auto i = 0U; i < nInputs; ++i)
+        {
+            if (!connected[i] || !audioRate[i])
+                continue;
+            anyAudioRate = true;
+            for (int c = 0; c < polyChans; ++c)
+                audioInputs[i][c] = inputSSE(m, i, c);
+        }
+
+        for (auto p = 0U; p < nPar; ++p)
+        {
+            auto v0 = _mm_set1_ps(basevalues[p]);
+            bool addAudio = anyAudioRate && routeStart[p] != routeStart[p + 1];
+            for (int c = 0; c < polyChans; ++c)
+            {
+                rampSSE[p][c] = _mm_add_ps(rampSSE[p][c], dRampSSE[p][c]);
+                auto v = rampSSE[p][c];
+                if (addAudio)
+                {
+                    for (auto r = routeStart[p]; r < routeStart[p + 1]; ++r)
+                    {
+                        auto i = routeInput[r];
+                        if (audioRate[i])
+                            v = _mm_add_ps(v, _mm_mul_ps(muSSE[p][i], audioInputs[i][c]));
+                    }
                 }
+                valuesSSE[p][c] = v;
+                _mm_store_ps(&values[p][c * 4], v);
+                _mm_store_ps(&modvalues[p][c * 4], _mm_sub_ps(v, v0));
             }
         }
     }
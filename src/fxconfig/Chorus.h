@@ -32,6 +32,7 @@ namespace sst::surgext_rack::fx
 template <> constexpr int FXConfig<fxt_chorus4>::numParams() { return 8; }
 template <> constexpr bool FXConfig<fxt_chorus4>::usesClock() { return true; }
 template <> constexpr int FXConfig<fxt_chorus4>::specificParamCount() { return 2; }
+template <> constexpr bool FXConfig<fxt_chorus4>::allowsParallelVoices() { return true; }
 
 template <> FXConfig<fxt_chorus4>::layout_t FXConfig<fxt_chorus4>::getLayout()
 {
@@ -29,6 +29,7 @@ namespace sst::surgext_rack::fx
  * - two specific params for pre and post
  */
 template <> constexpr int FXConfig<fxt_distortion>::specificParamCount() { return 2; }
+template <> constexpr bool FXConfig<fxt_distortion>::allowsParallelVoices() { return true; }
 template <> FXConfig<fxt_distortion>::layout_t FXConfig<fxt_distortion>::getLayout()
 {
     const auto col = FXLayoutHelper::standardColumns_MM();
@@ -25,6 +25,7 @@ namespace sst::surgext_rack::fx
 {
 
 template <> constexpr int FXConfig<fxt_exciter>::numParams() { return 5; }
+template <> constexpr bool FXConfig<fxt_exciter>::allowsParallelVoices() { return true; }
 template <> FXConfig<fxt_exciter>::layout_t FXConfig<fxt_exciter>::getLayout()
 {
     const auto col = FXLayoutHelper::standardColumns_MM();
@@ -50,6 +50,7 @@ enum n_t
 /*
  */
 template <> constexpr bool FXConfig<fxt_neuron>::usesClock() { return true; }
+template <> constexpr bool FXConfig<fxt_neuron>::allowsParallelVoices() { return true; }
 template <> FXConfig<fxt_neuron>::layout_t FXConfig<fxt_neuron>::getLayout()
 {
     const auto col = FXLayoutHelper::standardColumns_MM();
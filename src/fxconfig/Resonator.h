@@ -30,6 +30,7 @@ namespace sst::surgext_rack::fx
  */
 
 template <> constexpr int FXConfig<fxt_resonator>::specificParamCount() { return 3; }
+template <> constexpr bool FXConfig<fxt_resonator>::allowsParallelVoices() { return true; }
 template <> FXConfig<fxt_resonator>::layout_t FXConfig<fxt_resonator>::getLayout()
 {
     const auto col = FXLayoutHelper::standardColumns_MM();
@@ -32,6 +32,7 @@ namespace sst::surgext_rack::fx
 template <> constexpr int FXConfig<fxt_rotaryspeaker>::numParams() { return 8; }
 template <> constexpr bool FXConfig<fxt_rotaryspeaker>::usesClock() { return true; }
 template <> constexpr int FXConfig<fxt_rotaryspeaker>::specificParamCount() { return 1; }
+template <> constexpr bool FXConfig<fxt_rotaryspeaker>::allowsParallelVoices() { return true; }
 template <> FXConfig<fxt_rotaryspeaker>::layout_t FXConfig<fxt_rotaryspeaker>::getLayout()
 {
     const auto col = FXLayoutHelper::standardColumns_MM();
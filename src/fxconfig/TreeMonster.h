@@ -27,6 +27,7 @@ namespace sst::surgext_rack::fx
 template <> constexpr int FXConfig<fxt_treemonster>::extraOutputs() { return 2; }
 template <> constexpr int FXConfig<fxt_treemonster>::numParams() { return 8; }
 template <> constexpr int FXConfig<fxt_treemonster>::specificParamCount() { return 2; }
+template <> constexpr bool FXConfig<fxt_treemonster>::allowsParallelVoices() { return true; }
 template <> FXConfig<fxt_treemonster>::layout_t FXConfig<fxt_treemonster>::getLayout()
 {
     const auto col = FXLayoutHelper::standardColumns_MM();
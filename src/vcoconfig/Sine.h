@@ -19,10 +19,82 @@
 #ifndef SURGE_XT_RACK_SRC_VCOCONFIG_SINE_H
 #define SURGE_XT_RACK_SRC_VCOCONFIG_SINE_H
 
+#include <mutex>
 #include "dsp/oscillators/SineOscillator.h"
+#include "sst/basic-blocks/dsp/FastMath.h"
 
 namespace sst::surgext_rack::vco
 {
+/*
+ * Plain sine voices (the default shape with no feedback, one unison voice, no drift and
+ * both cut filters off) four to an SSE op. Each lane follows the scalar SineOscillator's
+ * arithmetic for that setting: add the feedback term to the phase, wrap it into +/- pi,
+ * take fastsin, then advance and wrap the phase. The first Sine VCO runs a self test
+ * comparing this against a scalar SineOscillator bit for bit, and if they differ nothing
+ * uses the batch.
+ */
+template <> struct VCOVoiceBatch<ot_sine>
+{
+    static constexpr bool supported{true};
+
+    float phase alignas(16)[MAX_POLY]{};
+    float omega alignas(16)[MAX_POLY]{};
+    float lastvalue alignas(16)[MAX_POLY]{};
+    float output alignas(16)[MAX_POLY][BLOCK_SIZE_OS];
+    std::array<bool, MAX_POLY> active{}, pendingStart{}, fadingOut{};
+
+    struct SelfTest
+    {
+        std::atomic<bool> passed{false};
+        // the settings the test ran with, which are the ones the batch may take
+        int shape{0}, fmMode{0};
+    };
+    static SelfTest &selfTest()
+    {
+        static SelfTest st;
+        return st;
+    }
+
+    // The scalar oscillator's pitch_to_omega, limited to pi
+    static float omegaFor(SurgeStorage *s, float pitch)
+    {
+        return (float)std::min(M_PI, 2.0 * M_PI * Tunings::MIDI_0_FREQ * s->note_to_pitch(pitch) *
+                                         s->dsamplerate_os_inv);
+    }
+
+    void start(int c, float initialPhase)
+    {
+        phase[c] = initialPhase;
+        lastvalue[c] = 0.f;
+    }
+
+    void process(int nChan)
+    {
+        namespace dsp = sst::basic_blocks::dsp;
+        const auto zero = _mm_setzero_ps();
+        float res alignas(16)[4];
+        for (int c0 = 0; c0 < nChan; c0 += 4)
+        {
+            auto ph = _mm_load_ps(&phase[c0]);
+            auto om = _mm_load_ps(&omega[c0]);
+            auto lv = _mm_load_ps(&lastvalue[c0]);
+            for (int k = 0; k < BLOCK_SIZE_OS; ++k)
+            {
+                auto x = dsp::clampToPiRangeSSE(_mm_add_ps(ph, lv));
+                auto out = dsp::fastsinSSE(x);
+                // the feedback depth is zero whenever the batch runs
+                lv = _mm_mul_ps(out, zero);
+                ph = dsp::clampToPiRangeSSE(_mm_add_ps(ph, om));
+
+                _mm_store_ps(res, _mm_add_ps(zero, out));
+                for (int j = 0; j < 4; ++j)
+                    output[c0 + j][k] = res[j];
+            }
+            _mm_store_ps(&phase[c0], ph);
+            _mm_store_ps(&lastvalue[c0], lv);
+        }
+    }
+};
 
 template <> constexpr bool VCOConfig<ot_sine>::supportsUnison() { return true; }
 template <> VCOConfig<ot_sine>::layout_t VCOConfig<ot_sine>::getLayout()
@@ -70,6 +142,99 @@ template <> void VCOConfig<ot_sine>::oscillatorSpecificSetup(VCO<ot_sine> *m)
     }
 }
 
+/*
+ * Runs a scalar SineOscillator and a one voice batch side by side from phase zero at a
+ * spread of pitches, for every character filter and feedback flavour, and only lets the
+ * batch run if every sample of every block matches exactly. The spare oscillator slot is
+ * only used by the wavetable VCOs so a Sine VCO can borrow it for the test.
+ */
+template <> void VCOConfig<ot_sine>::voiceBatchSelfTest(VCO<ot_sine> *m)
+{
+    static std::once_flag once;
+    std::call_once(once, [m]() {
+        auto *storage = m->storage.get();
+        auto &patch = storage->getPatch();
+        auto *osc = &patch.scene[0].osc[2];
+        osc->type.val.i = ot_sine;
+
+        struct alignas(16) scratch_t
+        {
+            unsigned char buffer[oscillator_buffer_size];
+            pdata localcopy[n_scene_params];
+            VCOVoiceBatch<ot_sine> batch;
+        };
+        auto scratch = std::make_unique<scratch_t>();
+        memset(scratch->localcopy, 0, sizeof(scratch->localcopy));
+
+        auto *o = spawn_osc(ot_sine, storage, osc, scratch->localcopy, scratch->buffer);
+        o->init_ctrltypes();
+        o->init_default_values();
+        o->init_extra_config();
+        osc->retrigger.val.b = true;
+        osc->p[SineOscillator::sine_lowcut].deactivated = true;
+        osc->p[SineOscillator::sine_highcut].deactivated = true;
+        for (int i = 0; i < n_osc_params; ++i)
+            scratch->localcopy[osc->p[i].param_id_in_scene] = osc->p[i].val;
+
+        auto &st = VCOVoiceBatch<ot_sine>::selfTest();
+        st.shape = osc->p[SineOscillator::sine_shape].val.i;
+        st.fmMode = osc->p[SineOscillator::sine_FMmode].val.i;
+        bool pass = osc->p[SineOscillator::sine_feedback].val.f == 0.f &&
+                    osc->p[SineOscillator::sine_unison_voices].val.i == 1;
+
+        auto &batch = scratch->batch;
+        auto character = patch.character.val.i;
+        for (int ch = 0; ch < 3 && pass; ++ch)
+        {
+            patch.character.val.i = ch;
+            for (int deform = 0; deform < 2 && pass; ++deform)
+            {
+                osc->p[SineOscillator::sine_feedback].deform_type = deform;
+                for (auto pitch : {0.f, 36.f, 60.f, 69.5f, 96.f, 127.f})
+                {
+                    o->init(pitch);
+                    batch.start(0, 0.f);
+                    batch.omega[0] = VCOVoiceBatch<ot_sine>::omegaFor(storage, pitch);
+                    for (int b = 0; b < 32 && pass; ++b)
+                    {
+                        o->process_block(pitch, 0.f, true);
+                        batch.process(1);
+                        pass = memcmp(o->output, batch.output[0], sizeof(o->output)) == 0 &&
+                               memcmp(o->outputR, batch.output[0], sizeof(o->outputR)) == 0;
+                    }
+                }
+            }
+        }
+        patch.character.val.i = character;
+        o->~Oscillator();
+
+        if (!pass)
+            WARN("Sine voice batch differs from SineOscillator; using the scalar oscillator");
+        st.passed = pass;
+    });
+}
+
+template <> bool VCOConfig<ot_sine>::voiceBatchEligible(VCO<ot_sine> *m, float drift)
+{
+    auto &st = VCOVoiceBatch<ot_sine>::selfTest();
+    if (!st.passed || drift != 0.f)
+        return false;
+
+    for (auto i : {SineOscillator::sine_shape, SineOscillator::sine_feedback,
+                   SineOscillator::sine_FMmode, SineOscillator::sine_unison_voices})
+    {
+        if (m->voiceModulated[i])
+            return false;
+    }
+    const auto &p = m->oscstorage->p;
+    return p[SineOscillator::sine_shape].val.i == st.shape &&
+           p[SineOscillator::sine_feedback].val.f == 0.f &&
+           p[SineOscillator::sine_FMmode].val.i == st.fmMode &&
+           p[SineOscillator::sine_unison_voices].val.i == 1 &&
+           p[SineOscillator::sine_lowcut].deactivated &&
+           p[SineOscillator::sine_highcut].deactivated;
+}
+
 template <> void VCOConfig<ot_sine>::processVCOSpecificParameters(VCO<ot_sine> *m)
 {
     auto l0 = (bool)(m->params[VCO<ot_sine>::ARBITRARY_SWITCH_0 + 0].getValue() > 0.5);